@@ -0,0 +1,242 @@
+#ifndef __ARENA_HH__
+#define __ARENA_HH__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <linux/mempolicy.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+// the NUMA node of a cpu, -1 if unknown
+inline int cpuNode(size_t cpu)
+{
+    cpu %= std::max(1u, std::thread::hardware_concurrency());
+    std::error_code ec;
+    for (const auto &entry : std::filesystem::directory_iterator(fmt::format("/sys/devices/system/cpu/cpu{}", cpu), ec))
+    {
+        const auto name = entry.path().filename().string();
+        if (name.starts_with("node") && name.size() > 4)
+            return std::stoi(name.substr(4));
+    }
+    return -1;
+}
+
+// bump allocator for predictor tables, mapped in chunks aligned to huge pages
+// chunks are backed by transparent huge pages, or by explicit ones (MAP_HUGETLB) when asked and
+// available, and are placed on a NUMA node when one is given
+// a released allocation goes to a free list of its size and alignment and is handed out again to the
+// next allocation of the same shape, e.g. the same table of the next predictor of the same config, so
+// predictors created and destroyed next to long-lived ones do not grow the arena; the whole arena is
+// rewound once the last allocation is released
+class Arena
+{
+  public:
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t HUGE_PAGE = 2 << 20;
+
+  private:
+    struct Chunk
+    {
+        void *base;
+        size_t size;
+    };
+
+    const int numa_node;
+    const bool explicit_huge;
+    const size_t chunk_size;
+    std::vector<Chunk> chunks;
+    size_t used = 0; // of the last chunk
+    size_t live = 0;
+    std::map<std::pair<size_t, size_t>, std::vector<void *>> free_blocks; // by size and alignment
+    std::mutex lock;
+
+    inline static thread_local Arena *current_arena = nullptr;
+
+    Chunk map(size_t size)
+    {
+        size = (size + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE;
+        void *base = MAP_FAILED;
+        if (explicit_huge)
+            base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            // over-map to align the chunk to a huge page, then trim the slack
+            auto *raw = static_cast<uint8_t *>(
+                ::mmap(nullptr, size + HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+            if (raw == MAP_FAILED)
+                throw std::bad_alloc();
+            auto *aligned = reinterpret_cast<uint8_t *>((uintptr_t(raw) + HUGE_PAGE - 1) / HUGE_PAGE * HUGE_PAGE);
+            if (aligned != raw)
+                ::munmap(raw, aligned - raw);
+            if (aligned + size != raw + size + HUGE_PAGE)
+                ::munmap(aligned + size, raw + HUGE_PAGE - aligned);
+            base = aligned;
+            ::madvise(base, size, MADV_HUGEPAGE);
+        }
+        if (numa_node >= 0)
+        {
+            // preferred rather than bound, so that a full node falls back to the others
+            const unsigned long nodemask = 1ul << numa_node;
+            ::syscall(SYS_mbind, base, size, MPOL_PREFERRED, &nodemask, sizeof(nodemask) * 8, 0);
+        }
+        return {base, size};
+    }
+
+  public:
+    explicit Arena(int numa_node = -1, bool explicit_huge = false, size_t chunk_size = 16 * HUGE_PAGE)
+        : numa_node(numa_node), explicit_huge(explicit_huge), chunk_size(chunk_size)
+    {
+    }
+
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+
+    ~Arena()
+    {
+        for (const auto &chunk : chunks)
+            ::munmap(chunk.base, chunk.size);
+    }
+
+    void *allocate(size_t size, size_t align = CACHE_LINE)
+    {
+        align = std::max(align, CACHE_LINE);
+        std::lock_guard guard(lock);
+        live++;
+        if (const auto found = free_blocks.find({size, align}); found != free_blocks.end() && !found->second.empty())
+        {
+            auto *block = found->second.back();
+            found->second.pop_back();
+            return block;
+        }
+        auto offset = (used + align - 1) / align * align;
+        if (chunks.empty() || offset + size > chunks.back().size)
+        {
+            chunks.push_back(map(std::max(size, chunk_size)));
+            offset = 0;
+        }
+        used = offset + size;
+        return static_cast<uint8_t *>(chunks.back().base) + offset;
+    }
+
+    // size and align as passed to allocate
+    void release(void *block, size_t size, size_t align = CACHE_LINE)
+    {
+        align = std::max(align, CACHE_LINE);
+        std::lock_guard guard(lock);
+        if (--live)
+        {
+            free_blocks[{size, align}].push_back(block);
+            return;
+        }
+        free_blocks.clear();
+        // keep the first chunk mapped for the next predictor
+        for (size_t i = 1; i < chunks.size(); i++)
+            ::munmap(chunks[i].base, chunks[i].size);
+        chunks.resize(std::min<size_t>(chunks.size(), 1));
+        used = 0;
+    }
+
+    // the arena of this thread, see ArenaScope, or a process-wide one
+    static Arena &current()
+    {
+        static Arena process_arena;
+        return current_arena ? *current_arena : process_arena;
+    }
+
+    friend class ArenaScope;
+};
+
+// predictors constructed on this thread while the scope is alive take their tables from the arena
+class ArenaScope
+{
+  private:
+    Arena *previous;
+
+  public:
+    explicit ArenaScope(Arena &arena) : previous(std::exchange(Arena::current_arena, &arena))
+    {
+    }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+    ~ArenaScope()
+    {
+        Arena::current_arena = previous;
+    }
+};
+
+// a fixed-size table of a predictor, value-initialized in the current arena
+template <typename T, size_t N>
+class ArenaArray
+{
+  private:
+    Arena *arena;
+    T *table;
+
+  public:
+    ArenaArray() : arena(&Arena::current()), table(static_cast<T *>(arena->allocate(sizeof(T) * N, alignof(T))))
+    {
+        std::uninitialized_value_construct_n(table, N);
+    }
+
+    ArenaArray(const ArenaArray &) = delete;
+    ArenaArray &operator=(const ArenaArray &) = delete;
+
+    ~ArenaArray()
+    {
+        std::destroy_n(table, N);
+        arena->release(table, sizeof(T) * N, alignof(T));
+    }
+
+    T &operator[](size_t i)
+    {
+        return table[i];
+    }
+
+    const T &operator[](size_t i) const
+    {
+        return table[i];
+    }
+
+    T *data()
+    {
+        return table;
+    }
+
+    T *begin()
+    {
+        return table;
+    }
+
+    T *end()
+    {
+        return table + N;
+    }
+
+    static constexpr size_t size()
+    {
+        return N;
+    }
+
+    // the table as a built-in array, e.g. for Snapshot
+    T (&array())[N]
+    {
+        return *reinterpret_cast<T(*)[N]>(table);
+    }
+};
+
+#endif
@@ -0,0 +1,115 @@
+// checks SetAssocBtb against a reference true-LRU model, and that a 1-way SetAssocBtb predicts as Btb
+// g++ -std=c++20 -O2 -march=native btb_check.cc -o btb_check -lfmt
+// ./btb_check, exits with 1 on a mismatch
+#include <algorithm>
+#include <cstdint>
+#include <fmt/core.h>
+#include <list>
+#include <map>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "../btb.hh"
+
+// every set a list of (tag, target) from the most to the least recently used
+template <size_t SET_WIDTH, size_t WAYS, size_t TAG_WIDTH, size_t PC_SHIFT_AMT = 2>
+class ReferenceLru
+{
+  private:
+    std::map<uint64_t, std::list<std::pair<uint64_t, uint64_t>>> sets;
+    uint64_t correct = 0;
+    uint64_t ct = 0;
+
+  public:
+    void step(const BranchRecord &record)
+    {
+        const auto ip = record.ip >> PC_SHIFT_AMT;
+        auto &set = sets[ip & bitmask(SET_WIDTH)];
+        const auto tag = (ip >> SET_WIDTH) & bitmask(TAG_WIDTH);
+        auto way = std::find_if(set.begin(), set.end(), [tag](const auto &entry) { return entry.first == tag; });
+        if (way != set.end())
+            set.splice(set.begin(), set, way); // a lookup is a use, taken or not
+        if (!record.taken)
+            return;
+        ct++;
+        if (way != set.end())
+        {
+            correct += set.front().second == record.target;
+            set.front().second = record.target;
+            return;
+        }
+        if (set.size() == WAYS)
+            set.pop_back();
+        set.emplace_front(tag, record.target);
+    }
+
+    Accuracy accuracy() const
+    {
+        return {correct, ct};
+    }
+};
+
+// a few thousand branches with exponentially skewed popularity and near targets, taken 7 times in 8
+std::vector<BranchRecord> checkTrace(size_t record_num)
+{
+    std::mt19937_64 rng(3);
+    std::vector<std::pair<uint64_t, uint64_t>> branches(3000);
+    for (auto &[ip, target] : branches)
+    {
+        ip = 0x400000 + rng() % 200000 * 4;
+        target = ip + int64_t(rng() % 20000) - 10000;
+    }
+    std::exponential_distribution<> popularity(0.003);
+    std::vector<BranchRecord> records(record_num);
+    for (auto &record : records)
+    {
+        const auto &[ip, target] = branches[std::min<size_t>(branches.size() - 1, popularity(rng))];
+        record = {ip, target, rng() % 8 != 0, BranchKind::CONDITIONAL, 4};
+    }
+    return records;
+}
+
+template <typename P>
+Accuracy run(const std::vector<BranchRecord> &records)
+{
+    auto predictor = std::make_unique<P>();
+    predictor->checkPredBatch(records);
+    return predictor->accuracy();
+}
+
+template <typename Model>
+Accuracy reference(const std::vector<BranchRecord> &records)
+{
+    Model model;
+    for (const auto &record : records)
+        model.step(record);
+    return model.accuracy();
+}
+
+bool check(const char *what, Accuracy got, Accuracy want)
+{
+    const bool same = got.correct == want.correct && got.total == want.total;
+    fmt::print("{:<40} {} / {} vs {} / {}: {}\n", what, got.correct, got.total, want.correct, want.total,
+               same ? "ok" : "MISMATCH");
+    return same;
+}
+
+int main()
+{
+    const auto records = checkTrace(2'000'000);
+    bool ok = true;
+    // 16-bit offsets hold every target of the trace, so no prediction is lost to a far target
+    ok &= check("SetAssocBtb<9, 2, 10> LRU", run<SetAssocBtb<9, 2, 10, 16, ReplPolicy::LRU>>(records),
+                reference<ReferenceLru<9, 2, 10>>(records));
+    ok &= check("SetAssocBtb<8, 4, 10> LRU", run<SetAssocBtb<8, 4, 10, 16, ReplPolicy::LRU>>(records),
+                reference<ReferenceLru<8, 4, 10>>(records));
+    ok &= check("SetAssocBtb<7, 8, 10> LRU", run<SetAssocBtb<7, 8, 10, 16, ReplPolicy::LRU>>(records),
+                reference<ReferenceLru<7, 8, 10>>(records));
+    ok &= check("SetAssocBtb<10, 1, 10> vs ReferenceLru", run<SetAssocBtb<10, 1, 10, 16>>(records),
+                reference<ReferenceLru<10, 1, 10>>(records));
+    ok &= check("SetAssocBtb<10, 1, 10> vs Btb<10, 10>", run<SetAssocBtb<10, 1, 10, 16>>(records),
+                run<Btb<10, 10>>(records));
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+// throughput of every predictor and of the hashing and counter kernels on a fixed synthetic trace, as JSON
+// g++ -std=c++20 -O2 -march=native predictor_bench.cc -o predictor_bench -lfmt -pthread
+// ./predictor_bench [records] [repetitions] > bench.json
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fmt/core.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../bimodal.hh"
+#include "../btb.hh"
+#include "../history.hh"
+#include "../ittage_config.hh"
+#include "../lbp.hh"
+#include "../perceptron_config.hh"
+#include "../ras.hh"
+#include "../tage_config.hh"
+#include "../util.hh"
+#include "synthetic.hh"
+
+template <typename F>
+double measure(F &&f)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+enum class Kind
+{
+    DIRECTION,
+    TARGET,
+    CALL_RETURN
+};
+
+// the branches of the trace a predictor of kind acts on
+size_t branchNum(const std::vector<BranchRecord> &records, Kind kind)
+{
+    return std::count_if(records.begin(), records.end(), [kind](const BranchRecord &record) {
+        switch (kind)
+        {
+        case Kind::DIRECTION:
+            return record.kind == BranchKind::CONDITIONAL;
+        case Kind::TARGET:
+            return true;
+        case Kind::CALL_RETURN:
+            return record.kind == BranchKind::CALL || record.kind == BranchKind::RETURN;
+        }
+        return false;
+    });
+}
+
+// the best of repetitions runs of a fresh predictor over the whole trace
+template <typename P>
+std::string benchPredictor(const char *alias, Kind kind, const std::vector<BranchRecord> &records, size_t repetitions)
+{
+    double best = 0;
+    Accuracy accuracy = {};
+    std::string name;
+    for (size_t i = 0; i < repetitions; i++)
+    {
+        auto predictor = std::make_unique<P>();
+        const auto seconds = measure([&] { predictor->checkPredBatch(records); });
+        best = i ? std::min(best, seconds) : seconds;
+        accuracy = predictor->accuracy();
+        name = predictor->getName();
+    }
+    const auto branches = branchNum(records, kind);
+    return fmt::format("    {{\"alias\": \"{}\", \"name\": \"{}\", \"branches\": {}, \"seconds\": {:.6f}, "
+                       "\"branches_per_sec\": {:.0f}, \"ns_per_branch\": {:.3f}, \"correct\": {}, \"predicted\": {}}}",
+                       alias, name, branches, best, branches / best, best / branches * 1e9, accuracy.correct,
+                       accuracy.total);
+}
+
+// the best of repetitions runs of a fresh predictor at every prefetch distance, see setPrefetchDistance
+template <typename P>
+void benchPrefetch(std::vector<std::string> &rows, const char *alias, Kind kind, const std::vector<BranchRecord> &records,
+                   size_t repetitions)
+{
+    const auto branches = branchNum(records, kind);
+    double base = 0;
+    for (const size_t distance : {0, 1, 2, 4, 8, 16, 32})
+    {
+        double best = 0;
+        for (size_t i = 0; i < repetitions; i++)
+        {
+            auto predictor = std::make_unique<P>();
+            predictor->setPrefetchDistance(distance);
+            const auto seconds = measure([&] { predictor->checkPredBatch(records); });
+            best = i ? std::min(best, seconds) : seconds;
+        }
+        base = distance ? base : best;
+        rows.push_back(fmt::format("    {{\"alias\": \"{}\", \"distance\": {}, \"seconds\": {:.6f}, "
+                                   "\"ns_per_branch\": {:.3f}, \"speedup\": {:.3f}}}",
+                                   alias, distance, best, best / branches * 1e9, base / best));
+    }
+}
+
+// the best of repetitions runs of f(i) for i in [0, ops), f returns a value folded into the checksum so
+// that the work is not optimized away
+template <typename F>
+std::string benchKernel(const char *name, size_t ops, size_t repetitions, F &&f)
+{
+    double best = 0;
+    uint64_t checksum = 0;
+    for (size_t r = 0; r < repetitions; r++)
+    {
+        checksum = 0;
+        const auto seconds = measure([&] {
+            for (size_t i = 0; i < ops; i++)
+                checksum += f(i);
+        });
+        best = r ? std::min(best, seconds) : seconds;
+    }
+    asm volatile("" : : "r"(checksum));
+    return fmt::format("    {{\"name\": \"{}\", \"ops\": {}, \"seconds\": {:.6f}, \"ns_per_op\": {:.3f}, "
+                       "\"checksum\": {}}}",
+                       name, ops, best, best / ops * 1e9, checksum);
+}
+
+std::string join(const std::vector<std::string> &items)
+{
+    std::string joined;
+    for (size_t i = 0; i < items.size(); i++)
+        joined += items[i] + (i + 1 < items.size() ? ",\n" : "\n");
+    return joined;
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t record_num = argc > 1 ? std::stoull(argv[1]) : 2'000'000;
+    const size_t repetitions = argc > 2 ? std::stoull(argv[2]) : 3;
+    const auto records = syntheticTrace(record_num);
+
+    std::vector<std::string> predictors;
+    auto direction = [&]<typename P>(const char *alias) {
+        predictors.push_back(benchPredictor<P>(alias, Kind::DIRECTION, records, repetitions));
+    };
+    auto target = [&]<typename P>(const char *alias) {
+        predictors.push_back(benchPredictor<P>(alias, Kind::TARGET, records, repetitions));
+    };
+
+    direction.operator()<Bimodal<2, 12>>("Bimodal<2, 12>");
+    direction.operator()<TwoLevelBranchPredictor<2, 0, 12, 0, 12>>("Global CONCAT");
+    direction.operator()<TwoLevelBranchPredictor<2, 0, 12, 12, 12, IndexAlgo::XOR>>("Global XOR");
+    direction.operator()<TwoLevelBranchPredictor<2, 10, 8, 4, 12>>("Local CONCAT");
+    direction.operator()<TwoLevelBranchPredictor<2, 10, 8, 12, 12, IndexAlgo::XOR>>("Local XOR");
+    direction.operator()<HugeTage>("HugeTage");
+    direction.operator()<HugeWithCondATage>("HugeWithCondATage");
+    direction.operator()<HugeWithCondLTage>("HugeWithCondLTage");
+    direction.operator()<HugeWith1UTage>("HugeWith1UTage");
+    direction.operator()<HugeWith1UCondATage>("HugeWith1UCondATage");
+    direction.operator()<HugeWith1UCondLTage>("HugeWith1UCondLTage");
+    direction.operator()<HugeWithRightShiftTage>("HugeWithRightShiftTage");
+    direction.operator()<HugeTageProbed>("HugeTageProbed");
+    direction.operator()<L32Tage>("L32Tage");
+    direction.operator()<HugeTageL>("HugeTageL");
+    direction.operator()<HugeTageSC>("HugeTageSC");
+    direction.operator()<HugeTageSCL>("HugeTageSCL");
+    direction.operator()<HugePerceptron>("HugePerceptron");
+    direction.operator()<L32Perceptron>("L32Perceptron");
+    target.operator()<Btb<10, 8>>("Btb TRUNC");
+    target.operator()<Btb<10, 8, TagAlgo::XOR>>("Btb XOR");
+    target.operator()<SetAssocBtb<8, 4, 10, 32, ReplPolicy::LRU>>("SetAssocBtb LRU");
+    target.operator()<SetAssocBtb<8, 4, 10, 32, ReplPolicy::PLRU>>("SetAssocBtb PLRU");
+    target.operator()<SetAssocBtb<8, 4, 10, 32, ReplPolicy::SRRIP>>("SetAssocBtb SRRIP");
+    target.operator()<HugeIttage>("HugeIttage");
+    target.operator()<L32Ittage>("L32Ittage");
+    predictors.push_back(benchPredictor<Ras<16, 2>>("Ras<16, 2>", Kind::CALL_RETURN, records, repetitions));
+
+    // the prefetch distance sweep, with tables from cache-resident up to well beyond the last level cache
+    std::vector<std::string> prefetch;
+    benchPrefetch<HugeTage>(prefetch, "HugeTage", Kind::DIRECTION, records, repetitions);
+    benchPrefetch<L32Tage>(prefetch, "L32Tage", Kind::DIRECTION, records, repetitions);
+    benchPrefetch<TwoLevelBranchPredictor<2, 0, 12, 12, 12, IndexAlgo::XOR>>(prefetch, "Global XOR", Kind::DIRECTION,
+                                                                              records, repetitions);
+    benchPrefetch<TwoLevelBranchPredictor<2, 0, 24, 24, 24, IndexAlgo::XOR>>(prefetch, "Global XOR<24, 24>",
+                                                                              Kind::DIRECTION, records, repetitions);
+    benchPrefetch<Btb<10, 8>>(prefetch, "Btb TRUNC", Kind::TARGET, records, repetitions);
+    benchPrefetch<HugeIttage>(prefetch, "HugeIttage", Kind::TARGET, records, repetitions);
+
+    // kernel inputs: fixed pseudo-random words and outcomes
+    constexpr size_t INPUT_NUM = 1 << 16;
+    std::vector<uint64_t> words(INPUT_NUM);
+    Xorshift rng(1);
+    for (auto &word : words)
+        word = rng.next();
+    const size_t ops = std::max<size_t>(record_num, INPUT_NUM);
+    auto word = [&words](size_t i) { return words[i % INPUT_NUM]; };
+
+    std::vector<std::string> kernels;
+    kernels.push_back(benchKernel("fold<64, 12>", ops, repetitions, [&](size_t i) { return fold<64, 12>(word(i)); }));
+    kernels.push_back(benchKernel("fold<32, 7>", ops, repetitions, [&](size_t i) { return fold<32, 7>(word(i)); }));
+    {
+        History<64> history;
+        kernels.push_back(benchKernel("foldHistory<64, 11>", ops, repetitions, [&](size_t i) {
+            history.push(word(i) & 1);
+            return foldHistory<64, 11>(history);
+        }));
+    }
+    {
+        History<64> history;
+        FoldedHistory folded(64, 11);
+        kernels.push_back(benchKernel("FoldedHistory(64, 11).update", ops, repetitions, [&](size_t i) {
+            const bool bit = word(i) & 1;
+            folded.update(bit, history);
+            history.push(bit);
+            return folded.get();
+        }));
+    }
+    kernels.push_back(benchKernel("getXoredIndex<62, 32, 12>", ops, repetitions, [&](size_t i) {
+        return getXoredIndex<62, 32, 12>(word(i), word(i + 1));
+    }));
+    {
+        Counter<2> ctr;
+        kernels.push_back(benchKernel("Counter<2>::update", ops, repetitions, [&](size_t i) {
+            ctr.update(word(i) & 1);
+            return ctr.to_ulong();
+        }));
+    }
+    {
+        Counter<8> ctr;
+        kernels.push_back(benchKernel("Counter<8>::update", ops, repetitions, [&](size_t i) {
+            ctr.update(word(i) & 1);
+            return ctr.to_ulong();
+        }));
+    }
+    {
+        Counter<2, true> ctr;
+        kernels.push_back(benchKernel("Counter<2, RSHIFT>::update", ops, repetitions, [&](size_t i) {
+            ctr.update(word(i) & 1);
+            return ctr.to_ulong();
+        }));
+    }
+
+    fmt::print("{{\n  \"records\": {},\n  \"repetitions\": {},\n  \"predictors\": [\n{}  ],\n  \"prefetch\": [\n{}  ],\n"
+               "  \"kernels\": [\n{}  ]\n}}\n",
+               record_num, repetitions, join(predictors), join(prefetch), join(kernels));
+}
@@ -0,0 +1,89 @@
+// cost and error of sampled simulation against a full run of the same predictor over the synthetic trace
+// g++ -std=c++20 -O2 -march=native sampling_bench.cc -o sampling_bench -lfmt -pthread
+// ./sampling_bench [records] [fast_forward] [interval] [warming] [repetitions]
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fmt/core.h>
+#include <memory>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../sampling.hh"
+#include "../tage_config.hh"
+#include "synthetic.hh"
+
+template <typename F>
+double measure(F &&f)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// the best of repetitions runs of f on a fresh predictor
+template <typename P, typename F>
+double best(size_t repetitions, F &&f)
+{
+    double best = 0;
+    for (size_t i = 0; i < repetitions; i++)
+    {
+        auto predictor = std::make_unique<P>();
+        const auto seconds = measure([&] { f(*predictor); });
+        best = i ? std::min(best, seconds) : seconds;
+    }
+    return best;
+}
+
+template <typename P>
+SampleEstimate sample(P &predictor, const std::vector<BranchRecord> &records, const SampledSimulation &sampling)
+{
+    bool done = false;
+    return sampling.run(predictor, [&]() -> std::span<const BranchRecord> {
+        return std::exchange(done, true) ? std::span<const BranchRecord>() : records;
+    });
+}
+
+// a full detailed run against sampled runs warming the whole fast-forward regions or only their ends
+template <typename P>
+void bench(const std::string &name, const std::vector<BranchRecord> &records, const SampledSimulation &warm_all,
+           const SampledSimulation &warm_end, size_t repetitions)
+{
+    Accuracy accuracy;
+    const auto full_seconds = best<P>(repetitions, [&](P &predictor) {
+        predictor.checkPredBatch(records);
+        accuracy = predictor.accuracy();
+    });
+    const auto full_accuracy = double(accuracy.correct) / accuracy.total;
+    fmt::print("{:<20} full         {:.3f}s {:.4f}%\n", name, full_seconds, full_accuracy * 100);
+
+    for (const auto &[label, sampling] : {std::pair{"warm all", &warm_all}, {"warm end", &warm_end}})
+    {
+        SampleEstimate estimate;
+        const auto seconds = best<P>(repetitions, [&](P &predictor) { estimate = sample(predictor, records, *sampling); });
+        fmt::print("{:<20} {:<12} {:.3f}s {:.4f}% +- {:.4f}%, speedup {:.2f}x, error {:+.4f}%\n", "", label, seconds,
+                   estimate.accuracy * 100, estimate.half_width * 100, full_seconds / seconds,
+                   (estimate.accuracy - full_accuracy) * 100);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t record_num = argc > 1 ? std::stoull(argv[1]) : 4'000'000;
+    const uint64_t fast_forward = argc > 2 ? std::stoull(argv[2]) : 90'000;
+    const uint64_t interval = argc > 3 ? std::stoull(argv[3]) : 10'000;
+    const uint64_t warming = argc > 4 ? std::stoull(argv[4]) : 20'000;
+    const size_t repetitions = argc > 5 ? std::stoull(argv[5]) : 3;
+    const auto records = syntheticTrace(record_num);
+    const SampledSimulation warm_all(fast_forward, interval), warm_end(fast_forward, interval, warming);
+
+    fmt::print("{} records, {} fast-forwarded, the last {} warmed with warm end, and {} measured in every period\n",
+               record_num, fast_forward, warming, interval);
+    bench<HugeTage>("HugeTage", records, warm_all, warm_end, repetitions);
+    bench<HugeWithCondATage>("HugeWithCondATage", records, warm_all, warm_end, repetitions);
+    bench<L32Tage>("L32Tage", records, warm_all, warm_end, repetitions);
+    bench<HugeTageSCL>("HugeTageSCL", records, warm_all, warm_end, repetitions);
+    bench<Bimodal<2, 12>>("Bimodal<2, 12>", records, warm_all, warm_end, repetitions);
+}
@@ -0,0 +1,65 @@
+// checks that a snapshot restores into a predictor of its own config and is rejected by configs sharing
+// its state layout
+// g++ -std=c++20 -O2 -march=native snapshot_check.cc -o snapshot_check -lfmt
+// ./snapshot_check, exits with 1 on a mismatch
+#include <cstdint>
+#include <filesystem>
+#include <fmt/core.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../btb.hh"
+#include "../ittage_config.hh"
+#include "../lbp.hh"
+#include "synthetic.hh"
+
+// HugeIttage decoding 19 instead of 20 target bits, which packs into the same entries
+using OffsetIttage = Ittage<8, 2, 2, 12, 27, 4, std::ratio<19, 10>, Huge_ittage_index_width, Huge_ittage_tag_width,
+                            64, 19, 8>;
+
+// save a predictor trained on the first half of the trace, restore it into To and run both on the rest
+template <typename From, typename To>
+bool check(const char *what, const std::vector<BranchRecord> &records, bool accept)
+{
+    const auto path = (std::filesystem::temp_directory_path() / "snapshot_check.snap").string();
+    const auto half = records.size() / 2;
+    auto saved = std::make_unique<From>();
+    saved->warmBatch(std::span(records).first(half));
+    saved->save(path);
+
+    auto restored = std::make_unique<To>();
+    std::string outcome = "restored";
+    bool same = accept;
+    try
+    {
+        restored->restore(path);
+        saved->checkPredBatch(std::span(records).subspan(half));
+        restored->checkPredBatch(std::span(records).subspan(half));
+        same = accept && saved->accuracy().correct == restored->accuracy().correct;
+    }
+    catch (const std::runtime_error &e)
+    {
+        outcome = e.what();
+        same = !accept;
+    }
+    std::filesystem::remove(path);
+    fmt::print("{:<40} {}: {}\n", what, outcome, same ? "ok" : "MISMATCH");
+    return same;
+}
+
+int main()
+{
+    const auto records = syntheticTrace(1'000'000);
+    using Concat = TwoLevelBranchPredictor<2, 0, 12, 0, 12>;
+    using Xor = TwoLevelBranchPredictor<2, 0, 12, 12, 12, IndexAlgo::XOR>;
+    bool ok = true;
+    ok &= check<Concat, Concat>("Global CONCAT into CONCAT", records, true);
+    ok &= check<Concat, Xor>("Global CONCAT into XOR", records, false);
+    ok &= check<Btb<10, 8>, Btb<10, 8>>("Btb TRUNC into TRUNC", records, true);
+    ok &= check<Btb<10, 8>, Btb<10, 8, TagAlgo::XOR>>("Btb TRUNC into XOR", records, false);
+    ok &= check<HugeIttage, HugeIttage>("HugeIttage into HugeIttage", records, true);
+    ok &= check<HugeIttage, OffsetIttage>("HugeIttage into 19 offset bits", records, false);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+#ifndef __SYNTHETIC_HH__
+#define __SYNTHETIC_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "../bp.hh"
+
+// a fixed, seeded branch trace mixing biased, loop, correlated and random conditional branches
+// with calls, returns and indirect jumps, so benchmark inputs are identical between commits
+inline std::vector<BranchRecord> syntheticTrace(size_t record_num, uint64_t seed = 88172645463325252ull)
+{
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+
+    std::vector<BranchRecord> records;
+    records.reserve(record_num);
+    std::vector<uint64_t> call_stack;
+    uint64_t loop = 0;
+    bool last_taken = false;
+    while (records.size() < record_num)
+    {
+        const auto rand = next();
+        const uint64_t ip = 0x400000 + (rand >> 8) % 8192 * 4;
+        const auto site = ip / 4 % 16;
+        // every direct branch has a single target, only indirect sites pick one of several
+        const uint64_t target = ip + 64 + (ip * 0x9e3779b97f4a7c15ull >> 58) * 4;
+        BranchRecord record = {ip, target, true, BranchKind::CONDITIONAL, 4};
+        if (site == 0 && call_stack.size() < 64)
+        {
+            record.kind = BranchKind::CALL;
+            call_stack.push_back(record.fallthrough());
+        }
+        else if (site == 1 && !call_stack.empty())
+        {
+            record.kind = BranchKind::RETURN;
+            record.target = call_stack.back();
+            call_stack.pop_back();
+        }
+        else if (site == 2)
+        {
+            record.kind = BranchKind::INDIRECT;
+            record.target = 0x800000 + (rand >> 50) % 4 * 0x100;
+        }
+        else if (site < 6)
+            record.taken = loop++ % 7 != 0; // loop exits
+        else if (site < 9)
+            record.taken = !last_taken; // correlated with the previous branch
+        else if (site < 10)
+            record.taken = (rand >> 33) & 1; // random
+        else
+            record.taken = ip / 64 % 4 != 0; // biased
+        if (record.kind == BranchKind::CONDITIONAL)
+            last_taken = record.taken;
+        records.push_back(record);
+    }
+    return records;
+}
+
+// loops with a constant trip count each, entered in a random order, with a data dependent and a
+// biased branch in every iteration so that TAGE can only count the iterations of short loops
+inline std::vector<BranchRecord> loopTrace(size_t record_num, size_t loop_num = 16,
+                                           uint64_t seed = 88172645463325252ull)
+{
+    auto next = [&seed] {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+
+    std::vector<uint64_t> trips(loop_num);
+    for (auto &trip : trips)
+        trip = 10 + next() % 100;
+    std::vector<BranchRecord> records;
+    records.reserve(record_num);
+    while (records.size() < record_num)
+    {
+        const auto loop = next() % loop_num;
+        const uint64_t body = 0x400000 + loop * 0x40;
+        for (uint64_t i = 0; i < trips[loop] && records.size() < record_num; i++)
+        {
+            const auto rand = next();
+            records.push_back({body, body + 0x20, bool(rand & 1), BranchKind::CONDITIONAL, 4});
+            records.push_back({body + 8, body + 0x20, (rand >> 1) % 8 != 0, BranchKind::CONDITIONAL, 4});
+            records.push_back({body + 16, body, i + 1 < trips[loop], BranchKind::CONDITIONAL, 4});
+        }
+    }
+    records.resize(std::min(records.size(), record_num));
+    return records;
+}
+
+#endif
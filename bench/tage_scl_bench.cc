@@ -0,0 +1,57 @@
+// lookup latency and throughput of each TAGE-SC-L stage on top of the same TAGE
+// g++ -std=c++20 -O2 -march=native tage_scl_bench.cc -o tage_scl_bench -lfmt
+// ./tage_scl_bench [records], over the synthetic trace and a trace of constant-trip loops
+#include <chrono>
+#include <cstdint>
+#include <fmt/core.h>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../tage_config.hh"
+#include "synthetic.hh"
+
+template <typename F>
+double measure(F &&f)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// throughput of predict + update over the trace, then the latency of predict alone on the trained predictor
+// (the loop predictor only steps its iteration counts on update, so its checksum is that of its TAGE)
+template <typename P>
+void bench(const std::string &name, const std::vector<BranchRecord> &records)
+{
+    auto predictor = std::make_unique<P>();
+    const auto run_seconds = measure([&] { predictor->checkPredBatch(records); });
+    const auto accuracy = predictor->accuracy();
+
+    uint64_t taken = 0;
+    const auto lookup_seconds = measure([&] {
+        for (const auto &record : records)
+            if (record.kind == BranchKind::CONDITIONAL)
+                taken += predictor->P::predict(record.ip);
+    });
+
+    fmt::print("{:<12} {:>8.2f} Mbranches/s {:>8.2f} ns/lookup {:>9.4f}% accuracy (checksum {})\n", name,
+               accuracy.total / run_seconds / 1e6, lookup_seconds / accuracy.total * 1e9,
+               100.0 * accuracy.correct / accuracy.total, taken);
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t record_num = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+    for (const auto &[trace, records] : {std::pair{"synthetic", syntheticTrace(record_num)},
+                                         {"constant-trip loops", loopTrace(record_num)}})
+    {
+        fmt::print("{} trace:\n", trace);
+        bench<HugeTage>("TAGE", records);
+        bench<TageScl<HugeTage, false, false>>("TAGE (wrap)", records);
+        bench<HugeTageL>("TAGE-L", records);
+        bench<HugeTageSC>("TAGE-SC", records);
+        bench<HugeTageSCL>("TAGE-SC-L", records);
+    }
+}
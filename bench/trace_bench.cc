@@ -0,0 +1,94 @@
+// throughput of the raw mapped trace against the compressed streaming trace
+// g++ -std=c++20 -O2 -march=native trace_bench.cc -o trace_bench -lfmt -pthread
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fmt/core.h>
+#include <string>
+
+#include "../bimodal.hh"
+#include "../compressed_trace.hh"
+#include "../trace.hh"
+#include "synthetic.hh"
+
+template <typename F>
+double measure(F &&f)
+{
+    const auto begin = std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t record_num = argc > 1 ? std::stoull(argv[1]) : 50'000'000;
+    const std::string dir = argc > 2 ? argv[2] : "/tmp";
+    const auto raw_path = dir + "/trace_bench.bpt";
+    const auto compressed_path = dir + "/trace_bench.bptz";
+
+    {
+        const auto records = syntheticTrace(record_num);
+        TraceWriter writer(raw_path);
+        for (const auto &record : records)
+            writer.write(record);
+        writer.close();
+        compressTrace(records, compressed_path);
+    }
+
+    auto report = [record_num](const char *name, const std::string &path, double seconds, uint64_t checksum) {
+        FILE *file = std::fopen(path.c_str(), "rb");
+        std::fseek(file, 0, SEEK_END);
+        const auto size = std::ftell(file);
+        std::fclose(file);
+        fmt::print("{:<28} {:>8.2f} MB {:>6.2f} B/record {:>8.2f} Mrecords/s (checksum {:x})\n", name, size / 1e6,
+                   double(size) / record_num, record_num / seconds / 1e6, checksum);
+    };
+
+    uint64_t checksum = 0;
+    auto scan = [&checksum](std::span<const BranchRecord> batch) {
+        for (const auto &record : batch)
+            checksum += record.ip ^ record.target ^ record.taken;
+    };
+
+    {
+        MappedTrace trace(raw_path);
+        checksum = 0;
+        const auto seconds = measure([&] {
+            for (auto batch = trace.next(1 << 16); !batch.empty(); batch = trace.next(1 << 16))
+                scan(batch);
+        });
+        report("raw scan", raw_path, seconds, checksum);
+    }
+    {
+        checksum = 0;
+        const auto seconds = measure([&] {
+            CompressedTraceReader trace(compressed_path);
+            for (auto batch = trace.next(); !batch.empty(); batch = trace.next())
+                scan(batch);
+        });
+        report("compressed scan", compressed_path, seconds, checksum);
+    }
+
+    Bimodal<2, 14> raw_bimodal, compressed_bimodal;
+    {
+        MappedTrace trace(raw_path);
+        const auto seconds = measure([&] {
+            for (auto batch = trace.next(1 << 16); !batch.empty(); batch = trace.next(1 << 16))
+                raw_bimodal.checkPredBatch(batch);
+        });
+        report("raw + Bimodal", raw_path, seconds, 0);
+    }
+    {
+        const auto seconds = measure([&] {
+            CompressedTraceReader trace(compressed_path);
+            for (auto batch = trace.next(); !batch.empty(); batch = trace.next())
+                compressed_bimodal.checkPredBatch(batch);
+        });
+        report("compressed + Bimodal", compressed_path, seconds, 0);
+    }
+    raw_bimodal.statistic();
+    compressed_bimodal.statistic();
+
+    std::remove(raw_path.c_str());
+    std::remove(compressed_path.c_str());
+}
@@ -4,13 +4,14 @@
 #include <cstddef>
 #include <cstdint>
 
+#include "arena.hh"
 #include "bp.hh"
 template <size_t CTR_WIDTH, size_t BIMODAL_WIDTH, size_t PC_SHIFT_AMT = 3>
 class Bimodal : public IDirectionPredictor
 {
   private:
     using Ctr = Counter<CTR_WIDTH>;
-    Ctr bimodal_table[exp2(BIMODAL_WIDTH)];
+    ArenaArray<Ctr, exp2(BIMODAL_WIDTH)> bimodal_table;
 
     uint64_t getIndex(uint64_t ip)
     {
@@ -26,7 +27,7 @@ class Bimodal : public IDirectionPredictor
 
     const std::string &getName() override
     {
-        static const std::string name = fmt::format("Bimodal<{}>", BIMODAL_WIDTH);
+        static const std::string name = fmt::format("Bimodal<{}, {}, {}>", CTR_WIDTH, BIMODAL_WIDTH, PC_SHIFT_AMT);
         return name;
     }
 
@@ -43,6 +44,26 @@ class Bimodal : public IDirectionPredictor
         auto index = getIndex(ip);
         bimodal_table[index].update(taken);
     }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Bimodal>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Bimodal, false>(records);
+    }
+
+    void skipBatch(std::span<const BranchRecord>) override
+    {
+        // no history to advance
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        s.raw(bimodal_table.array());
+    }
 };
 
 #endif
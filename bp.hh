@@ -1,21 +1,112 @@
 #ifndef __BP_HH__
 #define __BP_HH__
 
-#include <bitset>
 #include <cstddef>
 #include <cstdint>
 #include <fmt/core.h>
 #include <iostream>
+#include <span>
 #include <stdint.h>
 #include <string>
 
+#include "profiler.hh"
+#include "snapshot.hh"
 #include "util.hh"
 
+enum class BranchKind : uint8_t
+{
+    CONDITIONAL,
+    UNCONDITIONAL, // direct jump
+    CALL,          // direct or indirect call
+    RETURN,
+    INDIRECT // indirect jump
+};
+
+struct BranchRecord
+{
+    uint64_t ip;
+    uint64_t target;
+    bool taken;
+    BranchKind kind;
+    uint8_t inst_size; // the return address of a call is ip + inst_size
+
+    uint64_t fallthrough() const
+    {
+        return ip + inst_size;
+    }
+};
+
+struct Accuracy
+{
+    uint64_t correct;
+    uint64_t total;
+};
+
 class IPredictor
 {
+  protected:
+    size_t prefetch_distance = 0; // see setPrefetchDistance
+
   public:
+    virtual ~IPredictor() = default;
+
     virtual const std::string &getName() = 0;
-    virtual void statistic() = 0;
+    virtual std::string report() = 0; // what statistic() prints
+    virtual Accuracy accuracy() = 0;
+    virtual void checkPredBatch(std::span<const BranchRecord> records) = 0;
+    // train on the batch without counting statistics, for functional warming; a predictor may take a
+    // cheaper path than checkPredBatch there, see Tage::warm
+    virtual void warmBatch(std::span<const BranchRecord> records) = 0;
+    // only advance the histories over the batch, leaving the tables alone, for the part of a long
+    // fast-forward that is not worth warming; predictors without a cheaper path warm instead
+    virtual void skipBatch(std::span<const BranchRecord> records)
+    {
+        warmBatch(records);
+    }
+
+    // walk the predictor state, statistics excluded, see Snapshot
+    virtual void snapshot(Snapshot &s) = 0;
+
+    // timings of the stages of the predictor, empty unless it is instrumented
+    virtual std::string probes()
+    {
+        return "";
+    }
+
+    // add the misprediction profile of this predictor to profile, only direction predictors keep one
+    virtual void mergeProfile(DirectionProfiler &)
+    {
+    }
+
+    virtual void statistic()
+    {
+        fmt::print("{}{}", report(), probes());
+    }
+
+    // batches look this many records ahead and prefetch the table entries of those branches, 0 disables it
+    // only predictors with a lookahead hook (see checkPredBatchImpl) prefetch anything
+    void setPrefetchDistance(size_t distance)
+    {
+        prefetch_distance = distance;
+    }
+
+    void save(const std::string &path)
+    {
+        SnapshotWriter writer;
+        snapshot(writer);
+        writer.write(path, getName());
+    }
+
+    // the predictor must have the same configuration as the saved one
+    void restore(const std::string &path)
+    {
+        SnapshotReader reader(path);
+        if (reader.getName() != getName())
+            throw std::runtime_error(fmt::format("snapshot of {} restored into {}", reader.getName(), getName()));
+        snapshot(reader);
+        if (!reader.exhausted())
+            throw std::runtime_error("snapshot does not match the predictor");
+    }
 };
 
 class IDirectionPredictor : public IPredictor
@@ -27,21 +118,109 @@ class IDirectionPredictor : public IPredictor
   private:
     uint64_t pred_cnt = 0;
     uint64_t correct_cnt = 0;
+    [[no_unique_address]] DirectionProfiler profiler; // see BP_MISPREDICT_PROFILE
+
+    void countPred(uint64_t ip, bool pred, bool taken)
+    {
+        pred_cnt++;
+        correct_cnt += pred == taken;
+        if constexpr (DirectionProfiler::ENABLED)
+            if (pred != taken)
+                profiler.record(ip);
+    }
 
   public:
     virtual ~IDirectionPredictor() = default;
 
+  protected:
+    // checkPredBatch or warmBatch with predict/update bound statically to the concrete predictor
+    // a predictor providing lookaheadBegin() and lookahead(record) gets every conditional branch
+    // prefetch_distance records before it is predicted, lookaheadBegin() is called first in every batch
+    // a predictor providing warm(ip, taken) is warmed with it instead of predict and update
+    template <typename Derived, bool MEASURE = true>
+    void checkPredBatchImpl(std::span<const BranchRecord> records)
+    {
+        auto *self = static_cast<Derived *>(this);
+        constexpr bool LOOKAHEAD = requires(Derived &d, const BranchRecord &r) { d.lookahead(r); };
+        constexpr bool WARM = requires(Derived &d) { d.warm(uint64_t(), bool()); };
+        const auto distance = LOOKAHEAD ? prefetch_distance : 0;
+        if constexpr (LOOKAHEAD)
+            if (distance)
+                self->Derived::lookaheadBegin();
+        for (size_t i = 0, ahead = 0; i < records.size(); i++)
+        {
+            if constexpr (LOOKAHEAD)
+                for (; distance && ahead <= i + distance && ahead < records.size(); ahead++)
+                    if (records[ahead].kind == BranchKind::CONDITIONAL)
+                        self->Derived::lookahead(records[ahead]);
+            const auto &record = records[i];
+            if (record.kind != BranchKind::CONDITIONAL)
+                continue;
+            if constexpr (!MEASURE && WARM)
+            {
+                self->Derived::warm(record.ip, record.taken);
+                continue;
+            }
+            // update may depend on the state left by predict, so both run even when warming
+            const auto pred = self->Derived::predict(record.ip);
+            if constexpr (MEASURE)
+                countPred(record.ip, pred, record.taken);
+            self->Derived::update(record.ip, record.taken);
+        }
+    }
+
+  public:
     void checkPred(uint64_t ip, bool taken)
     {
-        pred_cnt++;
-        correct_cnt += predict(ip) == taken;
+        countPred(ip, predict(ip), taken);
         update(ip, taken);
     }
 
+    // checkPred on every conditional branch of the batch
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        for (const auto &record : records)
+            if (record.kind == BranchKind::CONDITIONAL)
+                checkPred(record.ip, record.taken);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        for (const auto &record : records)
+            if (record.kind == BranchKind::CONDITIONAL)
+            {
+                predict(record.ip);
+                update(record.ip, record.taken);
+            }
+    }
+
+    Accuracy accuracy() override
+    {
+        return {correct_cnt, pred_cnt};
+    }
+
+    std::string report() override
+    {
+        return fmt::format("{} prediction accuracy = {} / {} = {}%\n", getName(), correct_cnt, pred_cnt,
+                           (double)correct_cnt / pred_cnt * 100);
+    }
+
+    // the top mispredicting branches, empty unless built with BP_MISPREDICT_PROFILE
+    std::string profile(size_t top = 20)
+    {
+        if constexpr (DirectionProfiler::ENABLED)
+            return profiler.report(top);
+        return "";
+    }
+
+    void mergeProfile(DirectionProfiler &profile) override
+    {
+        profile.merge(profiler);
+    }
+
     void statistic() override
     {
-        fmt::print("{} prediction accuracy = {} / {} = {}%\n", getName(), correct_cnt, pred_cnt,
-                   (double)correct_cnt / pred_cnt * 100);
+        fmt::print("{}{}{}", report(), profile(), probes());
     }
 };
 
@@ -65,6 +244,39 @@ class ITargetPredictor : public IPredictor
   public:
     virtual ~ITargetPredictor() = default;
 
+  protected:
+    // checkPredBatch or warmBatch with predict/update bound statically to the concrete predictor
+    // with the same lookahead hooks as IDirectionPredictor, fed with every branch
+    template <typename Derived, bool MEASURE = true>
+    void checkPredBatchImpl(std::span<const BranchRecord> records)
+    {
+        auto *self = static_cast<Derived *>(this);
+        constexpr bool LOOKAHEAD = requires(Derived &d, const BranchRecord &r) { d.lookahead(r); };
+        const auto distance = LOOKAHEAD ? prefetch_distance : 0;
+        if constexpr (LOOKAHEAD)
+            if (distance)
+                self->Derived::lookaheadBegin();
+        for (size_t i = 0, ahead = 0; i < records.size(); i++)
+        {
+            if constexpr (LOOKAHEAD)
+                for (; distance && ahead <= i + distance && ahead < records.size(); ahead++)
+                    self->Derived::lookahead(records[ahead]);
+            const auto &record = records[i];
+            // update may depend on the state left by predict, so both run even when warming
+            const auto pred = self->Derived::predict(record.ip);
+            if constexpr (MEASURE)
+            {
+                pred_cnt++;
+                ct_cnt += record.taken;
+                correct_cnt += record.taken && pred && pred->addr == record.target;
+                mishit_cnt += !record.taken && pred;
+            }
+            if (record.taken)
+                self->Derived::update(record.ip, BranchTarget{record.target});
+        }
+    }
+
+  public:
     void checkPred(uint64_t ip, bool is_ct_inst, uint64_t addr)
     {
         pred_cnt++;
@@ -80,12 +292,35 @@ class ITargetPredictor : public IPredictor
             mishit_cnt++;
     }
 
-    void statistic() override
+    // checkPred on every branch of the batch, taken branches are the control transfers
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        for (const auto &record : records)
+            checkPred(record.ip, record.taken, record.target);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        for (const auto &record : records)
+        {
+            predict(record.ip);
+            if (record.taken)
+                update(record.ip, BranchTarget{record.target});
+        }
+    }
+
+    Accuracy accuracy() override
+    {
+        return {correct_cnt, ct_cnt};
+    }
+
+    std::string report() override
     {
         auto nonct_inst = pred_cnt - ct_cnt;
-        fmt::print("{}\n\t prediction accuracy = {} / {} = {}%\n", getName(), correct_cnt, ct_cnt,
-                   (double)correct_cnt / ct_cnt * 100);
-        fmt::print("\t mishit rate = {} / {} = {}%\n", mishit_cnt, nonct_inst, (double)mishit_cnt / nonct_inst * 100);
+        return fmt::format("{}\n\t prediction accuracy = {} / {} = {}%\n", getName(), correct_cnt, ct_cnt,
+                           (double)correct_cnt / ct_cnt * 100)
+               + fmt::format("\t mishit rate = {} / {} = {}%\n", mishit_cnt, nonct_inst,
+                             (double)mishit_cnt / nonct_inst * 100);
     }
 };
 
@@ -103,37 +338,96 @@ class ICallReturnPredictor : public IPredictor
 
     virtual void push(uint64_t addr) = 0;
 
+  protected:
+    // checkPredBatch or warmBatch with push/pop bound statically to the concrete predictor
+    template <typename Derived, bool MEASURE = true>
+    void checkPredBatchImpl(std::span<const BranchRecord> records)
+    {
+        auto *self = static_cast<Derived *>(this);
+        for (const auto &record : records)
+        {
+            if (record.kind == BranchKind::CALL)
+                self->Derived::push(record.fallthrough());
+            else if (record.kind == BranchKind::RETURN)
+            {
+                const auto ra = self->Derived::pop();
+                if constexpr (MEASURE)
+                {
+                    pred_cnt++;
+                    correct_cnt += ra == record.target;
+                }
+            }
+        }
+    }
+
+  public:
     void checkPred(uint64_t addr)
     {
         pred_cnt++;
         correct_cnt += pop() == addr;
     }
 
-    void statistic() override
+    // push the return address of every call and checkPred on every return of the batch
+    void checkPredBatch(std::span<const BranchRecord> records) override
     {
-        fmt::print("{} prediction accuracy = {} / {} = {}%\n", getName(), correct_cnt, pred_cnt,
-                   (double)correct_cnt / pred_cnt * 100);
+        for (const auto &record : records)
+        {
+            if (record.kind == BranchKind::CALL)
+                push(record.fallthrough());
+            else if (record.kind == BranchKind::RETURN)
+                checkPred(record.target);
+        }
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        for (const auto &record : records)
+        {
+            if (record.kind == BranchKind::CALL)
+                push(record.fallthrough());
+            else if (record.kind == BranchKind::RETURN)
+                pop();
+        }
+    }
+
+    Accuracy accuracy() override
+    {
+        return {correct_cnt, pred_cnt};
+    }
+
+    std::string report() override
+    {
+        return fmt::format("{} prediction accuracy = {} / {} = {}%\n", getName(), correct_cnt, pred_cnt,
+                           (double)correct_cnt / pred_cnt * 100);
     }
 };
 
 template <size_t width, bool RSHIFT_TO_DECRE = false>
-struct Counter : public std::bitset<width>
+    requires(width <= 64)
+struct Counter
 {
-    size_t max = bitmask(width);
+    using Value = LeastUint<width>;
+    static constexpr Value max = bitmask(width);
+
+    Value value = 0;
+
+    constexpr Counter() = default;
+    constexpr explicit Counter(uint64_t val) : value(val & max)
+    {
+    }
 
     Counter &operator++()
     {
-        if (this->to_ulong() < max)
-            *this = Counter(this->to_ulong() + 1);
+        value += value < max;
         return *this;
     }
     Counter &operator--()
     {
         if constexpr (RSHIFT_TO_DECRE)
             // substracting 1 to a whole table is not that realistic
-            *this >>= 1;
-        else if (long(this->to_ulong()) > 0)
-            *this = Counter(this->to_ulong() - 1);
+            value >>= 1;
+        else
+            value -= value > 0;
         return *this;
     }
     Counter operator++(int)
@@ -152,20 +446,44 @@ struct Counter : public std::bitset<width>
   public:
     void update(bool cond, bool decreCond = true)
     {
-        if (cond)
-            (*this)++;
-        else if (decreCond) // !cond && decreCond
-            (*this)--;
+        const Value decred = RSHIFT_TO_DECRE ? value >> 1 : value - (value > 0);
+        const Value incred = value + (value < max);
+        value = cond ? incred : decreCond ? decred : value;
+    }
+
+    bool get() const
+    {
+        return value >> (width - 1);
     }
 
-    bool get()
+    bool isStrong() const
     {
-        return (*this)[this->size() - 1];
+        return value == max || value == 0;
     }
 
-    bool isStrong()
+    bool all() const
+    {
+        return value == max;
+    }
+    bool any() const
+    {
+        return value != 0;
+    }
+    bool none() const
+    {
+        return value == 0;
+    }
+    void set()
+    {
+        value = max;
+    }
+    void reset()
+    {
+        value = 0;
+    }
+    uint64_t to_ulong() const
     {
-        return this->all() || this->none();
+        return value;
     }
 };
 
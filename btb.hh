@@ -1,18 +1,54 @@
 #ifndef __BTB_HH__
 #define __BTB_HH__
 
+#include <algorithm>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <string_view>
 
+#include "arena.hh"
 #include "bp.hh"
 #include "util.hh"
 
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
 enum class TagAlgo
 {
     TRUNC,
     XOR
 };
 
+// the tag of an ip whose lowest INDEX_WIDTH bits select the entry
+template <TagAlgo ALGO, size_t INDEX_WIDTH, size_t TAG_WIDTH>
+uint64_t btbTag(uint64_t ip)
+    requires(ALGO == TagAlgo::TRUNC)
+{
+    return (ip >> INDEX_WIDTH) & bitmask(TAG_WIDTH);
+}
+
+template <TagAlgo ALGO, size_t INDEX_WIDTH, size_t TAG_WIDTH>
+uint64_t btbTag(uint64_t ip)
+    requires(ALGO == TagAlgo::XOR)
+{
+    return fold<64 - INDEX_WIDTH, TAG_WIDTH>(ip >> INDEX_WIDTH);
+}
+
+constexpr std::string_view tagAlgoName(TagAlgo algo)
+{
+    switch (algo)
+    {
+    case TagAlgo::TRUNC:
+        return "TRUNC";
+    case TagAlgo::XOR:
+        return "XOR";
+    }
+    return "";
+}
+
 template <size_t BTB_WIDTH, size_t TAG_WIDTH, TagAlgo TAG_ALGO = TagAlgo::TRUNC, size_t PC_SHIFT_AMT = 2>
     requires(BTB_WIDTH + TAG_WIDTH <= 64)
 class Btb : public ITargetPredictor
@@ -25,36 +61,23 @@ class Btb : public ITargetPredictor
         BranchTarget target;
     };
 
-    BtbEntry btb[exp2(BTB_WIDTH)] = {};
+    ArenaArray<BtbEntry, exp2(BTB_WIDTH)> btb;
 
     uint64_t getIndex(uint64_t ip)
     {
         return ip & bitmask(BTB_WIDTH);
     }
 
-    template <TagAlgo ALGO>
-    uint64_t getTag(uint64_t ip)
-        requires(ALGO == TagAlgo::TRUNC)
-    {
-        return (ip >> BTB_WIDTH) & bitmask(TAG_WIDTH);
-    }
-
-    template <TagAlgo ALGO>
-    uint64_t getTag(uint64_t ip)
-        requires(ALGO == TagAlgo::XOR)
-    {
-        return fold<64 - BTB_WIDTH, TAG_WIDTH>(ip >> BTB_WIDTH);
-    }
-
     uint64_t getTag(uint64_t ip)
     {
-        return getTag<TAG_ALGO>(ip);
+        return btbTag<TAG_ALGO, BTB_WIDTH, TAG_WIDTH>(ip);
     }
 
   public:
     const std::string &getName() override
     {
-        static const std::string name = fmt::format("BTB<{}, {}>", BTB_WIDTH, TAG_WIDTH);
+        static const std::string name =
+            fmt::format("BTB<{}, {}, {}, {}>", BTB_WIDTH, TAG_WIDTH, tagAlgoName(TAG_ALGO), PC_SHIFT_AMT);
         return name;
     };
 
@@ -75,6 +98,340 @@ class Btb : public ITargetPredictor
         entry->target = target;
         entry->valid = true;
     }
+
+    // the index only depends on the ip
+    void lookaheadBegin()
+    {
+    }
+
+    void lookahead(const BranchRecord &record)
+    {
+        __builtin_prefetch(&btb[getIndex(record.ip >> PC_SHIFT_AMT)], 1);
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Btb>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Btb, false>(records);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        s.raw(btb.array());
+    }
+};
+
+enum class ReplPolicy
+{
+    LRU,
+    PLRU, // tree pseudo-LRU
+    SRRIP // static re-reference interval prediction with 2-bit RRPVs
+};
+
+constexpr std::string_view replPolicyName(ReplPolicy policy)
+{
+    switch (policy)
+    {
+    case ReplPolicy::LRU:
+        return "LRU";
+    case ReplPolicy::PLRU:
+        return "PLRU";
+    case ReplPolicy::SRRIP:
+        return "SRRIP";
+    }
+    return "";
+}
+
+// replacement state of one set: touch on a hit, insert on a fill, victim when every way is valid
+template <ReplPolicy POLICY, size_t WAYS>
+struct ReplState;
+
+template <size_t WAYS>
+struct ReplState<ReplPolicy::LRU, WAYS>
+{
+    static constexpr size_t MODELLED_BITS = WAYS * lg2(WAYS);
+
+    uint8_t age[WAYS]; // 0 for the most recently used way
+
+    ReplState()
+    {
+        for (size_t i = 0; i < WAYS; i++)
+            age[i] = uint8_t(i);
+    }
+
+    void touch(size_t way)
+    {
+        for (size_t i = 0; i < WAYS; i++)
+            age[i] += age[i] < age[way];
+        age[way] = 0;
+    }
+
+    void insert(size_t way)
+    {
+        touch(way);
+    }
+
+    size_t victim()
+    {
+        size_t oldest = 0;
+        for (size_t i = 1; i < WAYS; i++)
+            if (age[i] > age[oldest])
+                oldest = i;
+        return oldest;
+    }
+};
+
+template <size_t WAYS>
+struct ReplState<ReplPolicy::PLRU, WAYS>
+{
+    static_assert(std::has_single_bit(WAYS));
+    static constexpr size_t MODELLED_BITS = WAYS - 1;
+
+    // node n of the tree has children 2n + 1 and 2n + 2, its bit is set if the victim is on the right
+    LeastUint<std::max<size_t>(WAYS - 1, 1)> tree = 0;
+
+    void touch(size_t way)
+    {
+        for (size_t node = 0, low = 0, span = WAYS; span > 1; span /= 2)
+        {
+            const bool right = way >= low + span / 2;
+            tree = right ? tree & ~(1u << node) : tree | (1u << node);
+            low += right ? span / 2 : 0;
+            node = 2 * node + 1 + right;
+        }
+    }
+
+    void insert(size_t way)
+    {
+        touch(way);
+    }
+
+    size_t victim()
+    {
+        size_t low = 0;
+        for (size_t node = 0, span = WAYS; span > 1; span /= 2)
+        {
+            const bool right = (tree >> node) & 1;
+            low += right ? span / 2 : 0;
+            node = 2 * node + 1 + right;
+        }
+        return low;
+    }
+};
+
+template <size_t WAYS>
+struct ReplState<ReplPolicy::SRRIP, WAYS>
+{
+    static constexpr uint8_t RRPV_MAX = 3;
+    static constexpr size_t MODELLED_BITS = WAYS * 2;
+
+    uint8_t rrpv[WAYS];
+
+    ReplState()
+    {
+        std::fill(std::begin(rrpv), std::end(rrpv), RRPV_MAX);
+    }
+
+    void touch(size_t way)
+    {
+        rrpv[way] = 0;
+    }
+
+    // filled with a long re-reference interval, so that entries never hit again are evicted first
+    void insert(size_t way)
+    {
+        rrpv[way] = RRPV_MAX - 1;
+    }
+
+    size_t victim()
+    {
+        for (;;)
+        {
+            for (size_t i = 0; i < WAYS; i++)
+                if (rrpv[i] == RRPV_MAX)
+                    return i;
+            for (auto &value : rrpv)
+                value++;
+        }
+    }
+};
+
+// N-way set-associative BTB
+// a set keeps the tags of its ways side by side so that they are compared at once, and stores the targets
+// as TARGET_WIDTH-bit signed offsets from the branch instead of full addresses; branches whose target is
+// farther away are not cached
+// the resident size of an entry, its share of the set included, is checked against ENTRY_BUDGET bytes,
+// where the direct-mapped Btb takes 24
+template <size_t SET_WIDTH,              // log2 of the number of sets
+          size_t WAYS,                   // associativity
+          size_t TAG_WIDTH,              // width of the partial tags
+          size_t TARGET_WIDTH = 32,      // width of the target offsets
+          ReplPolicy POLICY = ReplPolicy::LRU,
+          TagAlgo TAG_ALGO = TagAlgo::TRUNC,
+          size_t ENTRY_BUDGET = 8,       // resident bytes per entry
+          size_t PC_SHIFT_AMT = 2        // the shift amount of inst pc to discard lowest bits
+          >
+    requires(WAYS >= 1 && WAYS <= 16 && TAG_WIDTH >= 1 && TAG_WIDTH <= 31 && TARGET_WIDTH >= 2
+             && TARGET_WIDTH <= 32 && SET_WIDTH + TAG_WIDTH <= 64)
+class SetAssocBtb : public ITargetPredictor
+{
+  private:
+    // the valid bit is stored above the tag, so that an invalid way or a padding lane never matches
+    using TagField = LeastUint<TAG_WIDTH + 1 <= 16 ? 16 : 32>;
+    using OffsetField = std::conditional_t<TARGET_WIDTH <= 16, int16_t, int32_t>;
+    static constexpr TagField VALID = TagField(1) << TAG_WIDTH;
+    // the tags of a set are compared in chunks of at least 4 bytes
+    static constexpr size_t TAG_LANES = (WAYS * sizeof(TagField) + 3) / 4 * 4 / sizeof(TagField);
+
+    struct BtbSet
+    {
+        TagField tag[TAG_LANES] = {};
+        OffsetField offset[WAYS] = {};
+        ReplState<POLICY, WAYS> repl;
+    };
+
+  public:
+    static constexpr size_t MODELLED_BITS = exp2(SET_WIDTH) * (WAYS * (1 + TAG_WIDTH + TARGET_WIDTH)
+                                                               + ReplState<POLICY, WAYS>::MODELLED_BITS);
+    static_assert(sizeof(BtbSet) <= ENTRY_BUDGET * WAYS, "entries exceed the memory budget");
+
+  private:
+    ArenaArray<BtbSet, exp2(SET_WIDTH)> sets;
+    BranchTarget predicted; // returned by predict
+    uint64_t far_cnt = 0;   // updates whose target does not fit in an offset
+
+    uint64_t getIndex(uint64_t ip)
+    {
+        return ip & bitmask(SET_WIDTH);
+    }
+
+    TagField getTag(uint64_t ip)
+    {
+        return VALID | TagField(btbTag<TAG_ALGO, SET_WIDTH, TAG_WIDTH>(ip));
+    }
+
+    // the way holding tag, WAYS if none
+    static size_t findWay(const BtbSet &set, TagField tag)
+    {
+#ifdef __SSE2__
+        constexpr size_t TAG_BYTES = sizeof(set.tag);
+        const auto key = sizeof(TagField) == 2 ? _mm_set1_epi16(int16_t(tag)) : _mm_set1_epi32(int32_t(tag));
+        const auto *bytes = reinterpret_cast<const uint8_t *>(set.tag);
+        uint64_t mask = 0; // one bit per byte of the tags
+        for (size_t i = 0; i < TAG_BYTES;)
+        {
+            __m128i chunk;
+            size_t width;
+            if (TAG_BYTES - i >= 16)
+                chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(bytes + i)), width = 16;
+            else if (TAG_BYTES - i >= 8)
+                chunk = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(bytes + i)), width = 8;
+            else
+            {
+                int32_t word;
+                std::memcpy(&word, bytes + i, sizeof(word));
+                chunk = _mm_cvtsi32_si128(word), width = 4;
+            }
+            const auto equal = sizeof(TagField) == 2 ? _mm_cmpeq_epi16(chunk, key) : _mm_cmpeq_epi32(chunk, key);
+            mask |= (uint64_t(uint32_t(_mm_movemask_epi8(equal))) & bitmask(width)) << i;
+            i += width;
+        }
+        // the tags of a set are distinct, so there is at most one match
+        return mask ? std::countr_zero(mask) / sizeof(TagField) : WAYS;
+#else
+        for (size_t i = 0; i < WAYS; i++)
+            if (set.tag[i] == tag)
+                return i;
+        return WAYS;
+#endif
+    }
+
+  public:
+    const std::string &getName() override
+    {
+        static const std::string name =
+            fmt::format("BTB<{}x{}, {}, {}, {}, {}, {}>", exp2(SET_WIDTH), WAYS, TAG_WIDTH, TARGET_WIDTH,
+                        replPolicyName(POLICY), tagAlgoName(TAG_ALGO), PC_SHIFT_AMT);
+        return name;
+    };
+
+    std::string report() override
+    {
+        return ITargetPredictor::report()
+               + fmt::format("\t far targets = {}\n", far_cnt)
+               + fmt::format("\t storage = {} Kbits modelled, {} B resident per entry\n", MODELLED_BITS / 1024.0,
+                             double(sizeof(BtbSet)) / WAYS);
+    }
+
+    BranchTarget *predict(uint64_t ip) override
+    {
+        const auto shifted = ip >> PC_SHIFT_AMT;
+        auto &set = sets[getIndex(shifted)];
+        const auto way = findWay(set, getTag(shifted));
+        if (way == WAYS)
+            return nullptr;
+        set.repl.touch(way);
+        predicted.addr = ip + int64_t(set.offset[way]);
+        return &predicted;
+    }
+
+    void update(uint64_t ip, BranchTarget target) override
+    {
+        const auto shifted = ip >> PC_SHIFT_AMT;
+        auto &set = sets[getIndex(shifted)];
+        const auto tag = getTag(shifted);
+        auto way = findWay(set, tag);
+        const auto offset = int64_t(target.addr - ip);
+        if (offset < -int64_t(exp2(TARGET_WIDTH - 1)) || offset >= int64_t(exp2(TARGET_WIDTH - 1)))
+        {
+            // a stale target is worse than none
+            far_cnt++;
+            if (way != WAYS)
+                set.tag[way] = 0;
+            return;
+        }
+        if (way == WAYS)
+        {
+            // invalid ways are filled first
+            way = findWay(set, 0);
+            if (way == WAYS)
+                way = set.repl.victim();
+            set.tag[way] = tag;
+            set.repl.insert(way);
+        }
+        else
+            set.repl.touch(way);
+        set.offset[way] = OffsetField(offset);
+    }
+
+    // the index only depends on the ip
+    void lookaheadBegin()
+    {
+    }
+
+    void lookahead(const BranchRecord &record)
+    {
+        __builtin_prefetch(&sets[getIndex(record.ip >> PC_SHIFT_AMT)], 1);
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<SetAssocBtb>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<SetAssocBtb, false>(records);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        s.raw(sets.array());
+    }
 };
 
 #endif
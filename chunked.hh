@@ -0,0 +1,129 @@
+#ifndef __CHUNKED_HH__
+#define __CHUNKED_HH__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "arena.hh"
+#include "bp.hh"
+#include "engine.hh"
+
+struct ChunkedResult
+{
+    Accuracy merged;
+    std::vector<Accuracy> chunks;
+    DirectionProfiler profile; // of all chunks in trace order, see BP_MISPREDICT_PROFILE
+
+    double accuracy() const
+    {
+        return merged.total ? double(merged.correct) / merged.total : 0;
+    }
+};
+
+// simulates K chunks of one trace in parallel, each on its own predictor instance which is first
+// warmed on the records preceding its chunk, then merges the per-chunk statistics and profiles
+class ChunkedSimulation
+{
+  private:
+    std::function<std::unique_ptr<IPredictor>()> create;
+    size_t chunk_num;
+    uint64_t warmup; // records warmed before every chunk but the first
+    size_t thread_num;
+
+  public:
+    ChunkedSimulation(std::function<std::unique_ptr<IPredictor>()> create, size_t chunk_num, uint64_t warmup,
+                      size_t thread_num = 0)
+        : create(std::move(create)), chunk_num(std::max<size_t>(1, chunk_num)), warmup(warmup),
+          thread_num(std::clamp<size_t>(thread_num ? thread_num : std::thread::hardware_concurrency(), 1,
+                                        this->chunk_num))
+    {
+    }
+
+    ChunkedResult run(std::span<const BranchRecord> trace) const
+    {
+        ChunkedResult result = {{0, 0}, std::vector<Accuracy>(chunk_num), {}};
+        std::vector<DirectionProfiler> profiles(chunk_num);
+        const auto chunk_size = (trace.size() + chunk_num - 1) / chunk_num;
+        std::atomic<size_t> next_chunk = 0;
+
+        auto work = [&](size_t worker) {
+            // the tables of the predictors of this worker stay on the NUMA node it is pinned to
+            Arena arena(cpuNode(worker));
+            ArenaScope scope(arena);
+            for (auto chunk = next_chunk++; chunk < chunk_num; chunk = next_chunk++)
+            {
+                const auto begin = std::min(chunk * chunk_size, trace.size());
+                const auto end = std::min(begin + chunk_size, trace.size());
+                const auto warm_begin = begin - std::min<uint64_t>(begin, warmup);
+                auto predictor = create();
+                predictor->warmBatch(trace.subspan(warm_begin, begin - warm_begin));
+                predictor->checkPredBatch(trace.subspan(begin, end - begin));
+                result.chunks[chunk] = predictor->accuracy();
+                predictor->mergeProfile(profiles[chunk]);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < thread_num; i++)
+        {
+            threads.emplace_back(work, i);
+            pinThread(threads.back(), i);
+        }
+        for (auto &thread : threads)
+            thread.join();
+
+        for (size_t chunk = 0; chunk < chunk_num; chunk++)
+        {
+            result.merged.correct += result.chunks[chunk].correct;
+            result.merged.total += result.chunks[chunk].total;
+            result.profile.merge(profiles[chunk]);
+        }
+        return result;
+    }
+};
+
+struct WarmupDrift
+{
+    uint64_t warmup;
+    double accuracy;
+    double drift; // chunked minus serial accuracy
+};
+
+// how far chunked runs with each warm-up length drift from a serial run of a calibration trace
+inline std::vector<WarmupDrift> calibrateWarmup(const std::function<std::unique_ptr<IPredictor>()> &create,
+                                                std::span<const BranchRecord> trace, size_t chunk_num,
+                                                std::span<const uint64_t> warmups, size_t thread_num = 0)
+{
+    auto serial = create();
+    serial->checkPredBatch(trace);
+    const auto serial_accuracy = serial->accuracy();
+    const auto reference = serial_accuracy.total ? double(serial_accuracy.correct) / serial_accuracy.total : 0;
+
+    std::vector<WarmupDrift> drifts;
+    for (const auto warmup : warmups)
+    {
+        const auto accuracy = ChunkedSimulation(create, chunk_num, warmup, thread_num).run(trace).accuracy();
+        drifts.push_back({warmup, accuracy, accuracy - reference});
+    }
+    return drifts;
+}
+
+inline std::string reportDrift(const std::string &name, std::span<const WarmupDrift> drifts)
+{
+    auto report = fmt::format("{} chunked accuracy drift from the serial run\n", name);
+    for (const auto &drift : drifts)
+        report += fmt::format("\t warm-up {:>10} records: {}% ({:+}%)\n", drift.warmup, drift.accuracy * 100,
+                              drift.drift * 100);
+    return report;
+}
+
+#endif
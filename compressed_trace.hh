@@ -0,0 +1,424 @@
+#ifndef __COMPRESSED_TRACE_HH__
+#define __COMPRESSED_TRACE_HH__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+#include "bp.hh"
+#include "trace.hh"
+
+// compressed branch trace: independently decodable blocks of records followed by a block index
+// a block starts with the bit-packed taken bits of its records, then every record is a byte holding
+// kind and inst_size plus the zigzag varints of ip - previous ip and target - ip
+struct CompressedTraceHeader
+{
+    static constexpr char MAGIC[8] = "BPTRACZ";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t block_size; // max records per block
+    uint64_t record_num;
+    uint64_t block_num;
+    uint64_t index_offset;
+};
+
+struct TraceBlockIndex
+{
+    uint64_t offset;
+    uint32_t byte_size;
+    uint32_t record_num;
+};
+
+inline uint64_t zigzag(int64_t val)
+{
+    return (uint64_t(val) << 1) ^ uint64_t(val >> 63);
+}
+
+inline int64_t unzigzag(uint64_t val)
+{
+    return int64_t(val >> 1) ^ -int64_t(val & 1);
+}
+
+inline void putVarint(std::vector<uint8_t> &out, uint64_t val)
+{
+    for (; val >= 0x80; val >>= 7)
+        out.push_back(uint8_t(val) | 0x80);
+    out.push_back(uint8_t(val));
+}
+
+inline uint64_t getVarint(const uint8_t *&in, const uint8_t *end)
+{
+    uint64_t val = 0;
+    for (unsigned shift = 0; in < end && shift < 64; shift += 7)
+    {
+        const auto byte = *in++;
+        val |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return val;
+    }
+    throw std::runtime_error("corrupted trace block");
+}
+
+inline void encodeTraceBlock(std::span<const BranchRecord> records, std::vector<uint8_t> &out)
+{
+    const auto bitmap_begin = out.size();
+    out.resize(bitmap_begin + (records.size() + 7) / 8);
+    for (size_t i = 0; i < records.size(); i++)
+        out[bitmap_begin + i / 8] |= uint8_t(records[i].taken) << (i % 8);
+
+    uint64_t last_ip = 0;
+    for (const auto &record : records)
+    {
+        if (record.inst_size >= 32)
+            throw std::invalid_argument(fmt::format("inst_size {} is not encodable", record.inst_size));
+        out.push_back(uint8_t(record.kind) | uint8_t(record.inst_size << 3));
+        putVarint(out, zigzag(int64_t(record.ip - last_ip)));
+        putVarint(out, zigzag(int64_t(record.target - record.ip)));
+        last_ip = record.ip;
+    }
+}
+
+inline void decodeTraceBlock(std::span<const uint8_t> block, std::span<BranchRecord> records)
+{
+    const auto bitmap_size = (records.size() + 7) / 8;
+    if (block.size() < bitmap_size)
+        throw std::runtime_error("corrupted trace block");
+    const uint8_t *in = block.data() + bitmap_size;
+    const uint8_t *const end = block.data() + block.size();
+
+    uint64_t last_ip = 0;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (in == end)
+            throw std::runtime_error("corrupted trace block");
+        const auto info = *in++;
+        auto &record = records[i];
+        record.kind = BranchKind(info & 0b111);
+        record.inst_size = info >> 3;
+        record.taken = (block[i / 8] >> (i % 8)) & 1;
+        record.ip = last_ip + unzigzag(getVarint(in, end));
+        record.target = record.ip + unzigzag(getVarint(in, end));
+        last_ip = record.ip;
+    }
+}
+
+class CompressedTraceWriter
+{
+  private:
+    std::string path;
+    FILE *file;
+    uint32_t block_size;
+    uint64_t record_num = 0;
+    uint64_t offset = sizeof(CompressedTraceHeader);
+    std::vector<BranchRecord> pending;
+    std::vector<uint8_t> encoded;
+    std::vector<TraceBlockIndex> index;
+
+    void put(const void *data, size_t size)
+    {
+        if (size && std::fwrite(data, size, 1, file) != 1)
+            throw traceError("failed to write trace", path);
+        offset += size;
+    }
+
+    void writeHeader(uint64_t index_offset)
+    {
+        CompressedTraceHeader header = {};
+        std::memcpy(header.magic, CompressedTraceHeader::MAGIC, sizeof(header.magic));
+        header.version = CompressedTraceHeader::VERSION;
+        header.block_size = block_size;
+        header.record_num = record_num;
+        header.block_num = index.size();
+        header.index_offset = index_offset;
+        if (std::fseek(file, 0, SEEK_SET) || std::fwrite(&header, sizeof(header), 1, file) != 1)
+            throw traceError("failed to write trace header of", path);
+    }
+
+    void flushBlock()
+    {
+        if (pending.empty())
+            return;
+        encoded.clear();
+        encodeTraceBlock(pending, encoded);
+        index.push_back({offset, uint32_t(encoded.size()), uint32_t(pending.size())});
+        put(encoded.data(), encoded.size());
+        pending.clear();
+    }
+
+  public:
+    explicit CompressedTraceWriter(const std::string &path, uint32_t block_size = 1 << 16)
+        : path(path), file(std::fopen(path.c_str(), "wb")), block_size(block_size)
+    {
+        if (!file)
+            throw traceError("failed to create trace", path);
+        pending.reserve(block_size);
+        writeHeader(0); // placeholder until the index is written
+    }
+
+    CompressedTraceWriter(const CompressedTraceWriter &) = delete;
+    CompressedTraceWriter &operator=(const CompressedTraceWriter &) = delete;
+
+    ~CompressedTraceWriter()
+    {
+        if (!file)
+            return;
+        try
+        {
+            close();
+        }
+        catch (const std::exception &)
+        {
+            // destructors must not throw, call close() to observe the error
+        }
+    }
+
+    void write(const BranchRecord &record)
+    {
+        pending.push_back(record);
+        record_num++;
+        if (pending.size() == block_size)
+            flushBlock();
+    }
+
+    void close()
+    {
+        if (!file)
+            return; // already closed, or closing failed
+        try
+        {
+            flushBlock();
+            const auto index_offset = offset;
+            put(index.data(), index.size() * sizeof(TraceBlockIndex));
+            writeHeader(index_offset);
+        }
+        catch (const std::exception &)
+        {
+            std::fclose(std::exchange(file, nullptr));
+            throw;
+        }
+        if (std::fclose(std::exchange(file, nullptr)))
+            throw traceError("failed to close trace", path);
+    }
+};
+
+inline void compressTrace(std::span<const BranchRecord> records, const std::string &path,
+                          uint32_t block_size = 1 << 16)
+{
+    CompressedTraceWriter writer(path, block_size);
+    for (const auto &record : records)
+        writer.write(record);
+    writer.close();
+}
+
+// streams a compressed trace, blocks are decoded ahead by a background thread into a single-producer
+// single-consumer ring of record batches so that the consumer only waits when it outruns the decoder
+class CompressedTraceReader
+{
+  private:
+    void *mapping = MAP_FAILED;
+    size_t mapping_size = 0;
+    const CompressedTraceHeader *header;
+    std::span<const TraceBlockIndex> index;
+
+    const size_t slot_num;
+    std::vector<BranchRecord> ring;
+    std::vector<uint32_t> slot_size; // an empty slot marks the end of the trace
+    std::atomic<uint64_t> produced = 0;
+    std::atomic<uint64_t> consumed = 0;
+    std::atomic<bool> stopping = false;
+    std::exception_ptr error;
+    std::thread decoder;
+
+    // consumer side
+    bool holding = false;
+    bool ended = false;
+
+    std::span<BranchRecord> slot(uint64_t n)
+    {
+        return std::span(ring).subspan(n % slot_num * header->block_size, header->block_size);
+    }
+
+    // wait for a free slot, false if the reader is being destroyed
+    bool acquireSlot(uint64_t n)
+    {
+        for (auto seen = consumed.load(std::memory_order_acquire); n - seen == slot_num;
+             seen = consumed.load(std::memory_order_acquire))
+        {
+            if (stopping.load(std::memory_order_relaxed))
+                return false;
+            consumed.wait(seen, std::memory_order_acquire);
+        }
+        return !stopping.load(std::memory_order_relaxed);
+    }
+
+    void publish(uint64_t n, uint32_t size)
+    {
+        slot_size[n % slot_num] = size;
+        produced.store(n + 1, std::memory_order_release);
+        produced.notify_one();
+    }
+
+    void decode()
+    {
+        const auto *base = static_cast<const uint8_t *>(mapping);
+        uint64_t n = 0;
+        try
+        {
+            for (const auto &block : index)
+            {
+                if (!acquireSlot(n))
+                    return;
+                decodeTraceBlock(std::span(base + block.offset, block.byte_size),
+                                 slot(n).first(block.record_num));
+                publish(n++, block.record_num);
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+        if (acquireSlot(n))
+            publish(n, 0);
+    }
+
+  public:
+    explicit CompressedTraceReader(const std::string &path, size_t slot_num = 8) : slot_num(slot_num)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw traceError("failed to open trace", path);
+        struct stat st;
+        if (::fstat(fd, &st))
+        {
+            ::close(fd);
+            throw traceError("failed to stat trace", path);
+        }
+        mapping_size = st.st_size;
+        if (mapping_size < sizeof(CompressedTraceHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("truncated trace {}", path));
+        }
+        mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            throw traceError("failed to map trace", path);
+        ::madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+        header = static_cast<const CompressedTraceHeader *>(mapping);
+        const auto valid = [this] {
+            if (std::memcmp(header->magic, CompressedTraceHeader::MAGIC, sizeof(header->magic))
+                || header->version != CompressedTraceHeader::VERSION || !header->block_size
+                || header->index_offset > mapping_size
+                || header->block_num > (mapping_size - header->index_offset) / sizeof(TraceBlockIndex))
+                return false;
+            index = std::span(reinterpret_cast<const TraceBlockIndex *>(static_cast<const uint8_t *>(mapping)
+                                                                        + header->index_offset),
+                              header->block_num);
+            for (const auto &block : index)
+                if (block.offset > mapping_size || block.byte_size > mapping_size - block.offset
+                    || !block.record_num || block.record_num > header->block_size)
+                    return false;
+            return true;
+        };
+        if (!valid())
+        {
+            ::munmap(mapping, mapping_size);
+            throw std::runtime_error(fmt::format("invalid trace {}", path));
+        }
+
+        ring.resize(slot_num * header->block_size);
+        slot_size.resize(slot_num);
+        decoder = std::thread(&CompressedTraceReader::decode, this);
+    }
+
+    CompressedTraceReader(const CompressedTraceReader &) = delete;
+    CompressedTraceReader &operator=(const CompressedTraceReader &) = delete;
+
+    ~CompressedTraceReader()
+    {
+        stopping.store(true, std::memory_order_relaxed);
+        consumed.fetch_add(1, std::memory_order_release); // wake the decoder up if the ring is full
+        consumed.notify_one();
+        decoder.join();
+        ::munmap(mapping, mapping_size);
+    }
+
+    size_t size() const
+    {
+        return header->record_num;
+    }
+
+    // the next decoded block, valid until the following call, empty at the end of the trace
+    std::span<const BranchRecord> next()
+    {
+        auto n = consumed.load(std::memory_order_relaxed);
+        if (holding)
+        {
+            consumed.store(++n, std::memory_order_release);
+            consumed.notify_one();
+            holding = false;
+        }
+        if (ended)
+            return {};
+
+        for (auto seen = produced.load(std::memory_order_acquire); seen == n;
+             seen = produced.load(std::memory_order_acquire))
+            produced.wait(seen, std::memory_order_acquire);
+
+        const auto size = slot_size[n % slot_num];
+        if (!size)
+        {
+            ended = true;
+            if (error)
+                std::rethrow_exception(error);
+            return {};
+        }
+        holding = true;
+        return slot(n).first(size);
+    }
+};
+
+// feed a raw or compressed trace to consume batch by batch, the format is told by the magic
+inline void readTrace(const std::string &path, const std::function<void(std::span<const BranchRecord>)> &consume,
+                      size_t batch_size = 1 << 16)
+{
+    char magic[8] = {};
+    FILE *file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        throw traceError("failed to open trace", path);
+    const auto read = std::fread(magic, sizeof(magic), 1, file);
+    std::fclose(file);
+
+    if (read && !std::memcmp(magic, CompressedTraceHeader::MAGIC, sizeof(magic)))
+    {
+        CompressedTraceReader trace(path);
+        for (auto batch = trace.next(); !batch.empty(); batch = trace.next())
+            consume(batch);
+    }
+    else
+    {
+        MappedTrace trace(path);
+        for (auto batch = trace.next(batch_size); !batch.empty(); batch = trace.next(batch_size))
+            consume(batch);
+    }
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef __ENGINE_HH__
+#define __ENGINE_HH__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <pthread.h>
+#include <sched.h>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "bp.hh"
+
+// the next batch of a trace, empty at the end
+using BatchSource = std::function<std::span<const BranchRecord>()>;
+
+inline void pinThread(std::thread &thread, size_t cpu)
+{
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu % std::max(1u, std::thread::hardware_concurrency()), &cpus);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus);
+}
+
+// reads a trace once and fans every batch out to all predictors, which are spread over pinned
+// worker threads; a batch slot is only refilled after every worker is done with it
+class FanoutEngine
+{
+  private:
+    struct Slot
+    {
+        std::vector<BranchRecord> storage;
+        std::span<const BranchRecord> records; // empty marks the end of the trace
+        std::atomic<size_t> readers = 0;
+    };
+
+    std::vector<std::unique_ptr<IPredictor>> predictors;
+    const size_t thread_num;
+    const size_t slot_num;
+    const size_t batch_size;
+    std::unique_ptr<Slot[]> slots;
+    std::atomic<uint64_t> produced = 0;
+
+    void work(size_t worker, uint64_t first)
+    {
+        for (uint64_t n = first;; n++)
+        {
+            for (auto seen = produced.load(std::memory_order_acquire); seen <= n;
+                 seen = produced.load(std::memory_order_acquire))
+                produced.wait(seen, std::memory_order_acquire);
+
+            auto &slot = slots[n % slot_num];
+            if (slot.records.empty())
+                return;
+            for (auto i = worker; i < predictors.size(); i += thread_num)
+                predictors[i]->checkPredBatch(slot.records);
+            if (slot.readers.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                slot.readers.notify_one();
+        }
+    }
+
+    void publish(uint64_t n, std::span<const BranchRecord> records, bool copy)
+    {
+        auto &slot = slots[n % slot_num];
+        for (auto readers = slot.readers.load(std::memory_order_acquire); readers;
+             readers = slot.readers.load(std::memory_order_acquire))
+            slot.readers.wait(readers, std::memory_order_acquire);
+
+        if (copy)
+        {
+            slot.storage.assign(records.begin(), records.end());
+            records = slot.storage;
+        }
+        slot.records = records;
+        slot.readers.store(thread_num, std::memory_order_relaxed);
+        produced.store(n + 1, std::memory_order_release);
+        produced.notify_all();
+    }
+
+  public:
+    explicit FanoutEngine(std::vector<std::unique_ptr<IPredictor>> predictors, size_t thread_num = 0,
+                          size_t slot_num = 8, size_t batch_size = 1 << 16)
+        : predictors(std::move(predictors)),
+          thread_num(std::clamp<size_t>(thread_num ? thread_num : std::thread::hardware_concurrency(), 1,
+                                        std::max<size_t>(1, this->predictors.size()))),
+          slot_num(slot_num), batch_size(batch_size), slots(std::make_unique<Slot[]>(slot_num))
+    {
+    }
+
+    // run every predictor over the trace, stable sources (e.g. MappedTrace) are shared without copying
+    void run(const BatchSource &source, bool stable = false)
+    {
+        uint64_t n = produced.load(std::memory_order_relaxed);
+        std::vector<std::thread> workers;
+        for (size_t i = 0; i < thread_num; i++)
+        {
+            workers.emplace_back(&FanoutEngine::work, this, i, n);
+            pinThread(workers.back(), i);
+        }
+
+        for (auto records = source(); !records.empty(); records = source())
+            for (size_t i = 0; i < records.size(); i += batch_size)
+                publish(n++, records.subspan(i, std::min(batch_size, records.size() - i)), !stable);
+        publish(n++, {}, false);
+
+        for (auto &worker : workers)
+            worker.join();
+        // the end marker was never released by the workers
+        slots[(n - 1) % slot_num].readers.store(0, std::memory_order_relaxed);
+    }
+
+    void statistic()
+    {
+        for (auto &predictor : predictors)
+            predictor->statistic();
+    }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef __HISTORY_HH__
+#define __HISTORY_HH__
+
+#include <cstddef>
+#include <cstdint>
+
+#include "util.hh"
+
+// a bit history of at least LEN bits where history[0] is the newest bit
+// bits are kept in a power-of-two circular buffer so that pushing never moves the older bits
+template <size_t LEN>
+class History
+{
+  private:
+    static constexpr size_t CAPACITY = LEN <= 64 ? 64 : exp2(size_t(lg2(LEN - 1) + 1));
+    static constexpr size_t WORD_NUM = CAPACITY / 64;
+
+    uint64_t words[WORD_NUM] = {};
+    size_t head = 0; // position of history[0], moves downwards on push
+
+    static constexpr size_t wrap(size_t pos)
+    {
+        return pos & (CAPACITY - 1);
+    }
+
+  public:
+    static constexpr size_t size()
+    {
+        return LEN;
+    }
+
+    bool operator[](size_t i) const
+    {
+        const auto pos = wrap(head + i);
+        return (words[pos / 64] >> (pos % 64)) & 1;
+    }
+
+    void push(bool bit)
+    {
+        head = wrap(head - 1);
+        auto &word = words[head / 64];
+        word = (word & ~(1ull << (head % 64))) | (uint64_t(bit) << (head % 64));
+    }
+
+    // n <= 64 bits from history[start] on, with history[start] as the least significant bit
+    uint64_t segment(size_t start, size_t n) const
+    {
+        const auto pos = wrap(head + start);
+        const auto offset = pos % 64;
+        uint64_t bits = words[pos / 64] >> offset;
+        if (offset)
+            bits |= words[wrap(pos + 64) / 64] << (64 - offset);
+        return bits & bitmask(n);
+    }
+
+    // the newest n bits with history[0] as the least significant bit
+    uint64_t recent(size_t n) const
+    {
+        return segment(0, n);
+    }
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef __ITTAGE_HH__
+#define __ITTAGE_HH__
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <memory>
+
+#include "arena.hh"
+#include "bp.hh"
+#include "tage_components.hh"
+#include "util.hh"
+
+// targets are stored as a pointer into a small table of regions, the upper bits shared by many
+// targets, plus the OFFSET_WIDTH lowest bits
+// a region is replaced by the clock algorithm, and targets still pointing to it then predict wrong
+template <size_t REGION_NUM, size_t OFFSET_WIDTH>
+    requires(lg2(REGION_NUM) + OFFSET_WIDTH <= 31 && (REGION_NUM & (REGION_NUM - 1)) == 0)
+class TargetRegions
+{
+  public:
+    using Packed = uint32_t;
+    static constexpr Packed VALID = Packed(1) << 31; // unset for an empty target
+    static constexpr size_t MODELLED_BITS = REGION_NUM * (64 - OFFSET_WIDTH);
+    static constexpr size_t PACKED_BITS = 1 + lg2(REGION_NUM) + OFFSET_WIDTH;
+
+  private:
+    uint64_t region[REGION_NUM] = {};
+    bool valid[REGION_NUM] = {};
+    bool referenced[REGION_NUM] = {};
+    size_t hand = 0;
+
+  public:
+    Packed pack(uint64_t target)
+    {
+        const auto upper = target >> OFFSET_WIDTH;
+        size_t r = 0;
+        while (r < REGION_NUM && !(valid[r] && region[r] == upper))
+            r++;
+        if (r == REGION_NUM)
+        {
+            for (; referenced[hand]; hand = (hand + 1) % REGION_NUM)
+                referenced[hand] = false;
+            r = hand;
+            hand = (hand + 1) % REGION_NUM;
+            region[r] = upper;
+            valid[r] = true;
+        }
+        referenced[r] = true;
+        return VALID | Packed(r << OFFSET_WIDTH) | Packed(target & bitmask(OFFSET_WIDTH));
+    }
+
+    uint64_t unpack(Packed packed) const
+    {
+        return (region[(packed & ~VALID) >> OFFSET_WIDTH] << OFFSET_WIDTH) | (packed & bitmask(OFFSET_WIDTH));
+    }
+
+    // the packed target predicts target
+    bool hits(Packed packed, uint64_t target) const
+    {
+        return (packed & VALID) && unpack(packed) == target;
+    }
+};
+
+// ITTAGE indirect target predictor: the tagged components and histories of Tage, with a target and a
+// confidence counter instead of a direction counter in every entry, over a tagless PC-indexed base
+// every taken branch pushes one bit of its target into the global history
+template <size_t COMPONENT_NUM,                          // number of predictor components
+          size_t CTR_WIDTH,                              // width of confidence counters
+          size_t USEFUL_WIDTH,                           // width of useful counters
+          size_t BASE_WIDTH,                             // index width of the base predictor
+          size_t PATH_HIST_LEN,                          // length of the path history info
+          size_t MIN_HIST_LEN,                           // length of the shortest(first) global history info
+          ratioSpec HIST_ALPHA,                          // growth rate of the length of geometric global
+                                                         // history
+          std::array<size_t, COMPONENT_NUM> INDEX_WIDTH, // a array of indexes' width of components
+          std::array<size_t, COMPONENT_NUM> TAG_WIDTH,   // a array of tags' width of components
+          size_t REGION_NUM,                             // number of target regions
+          size_t OFFSET_WIDTH,                           // target bits stored in every entry
+          size_t RESET_WIDTH,                            // width of the allocation success counter
+                                                         // that resets the useful counters
+          size_t PC_SHIFT_AMT = 2                        // the shift amount of inst pc to discard lowest bits
+          >
+    requires(USEFUL_WIDTH > 1) // replaceable() reads a confidence of 0 as a strong direction otherwise
+class Ittage : public ITargetPredictor
+{
+  private:
+    static constexpr auto HIST_LEN = geometricHistLen<COMPONENT_NUM, MIN_HIST_LEN, HIST_ALPHA>();
+    static constexpr size_t MAX_HIST_LEN = HIST_LEN[COMPONENT_NUM - 1];
+    static constexpr size_t MAX_TAG_WIDTH = *std::max_element(TAG_WIDTH.begin(), TAG_WIDTH.end());
+
+    using IttageEntry = TaggedEntry<CTR_WIDTH, USEFUL_WIDTH, MAX_TAG_WIDTH, false>;
+    using HistoryState = TaggedHistory<COMPONENT_NUM, HIST_LEN, PATH_HIST_LEN, INDEX_WIDTH, TAG_WIDTH, false>;
+    using Tables = TaggedTables<IttageEntry, COMPONENT_NUM, INDEX_WIDTH>;
+    using LookupContext = typename Tables::LookupContext;
+    using CompEntry = typename Tables::CompEntry;
+    using Regions = TargetRegions<REGION_NUM, OFFSET_WIDTH>;
+    using Packed = typename Regions::Packed;
+
+  private:
+    HistoryState history;
+    // at the branch being looked ahead at, only allocated once prefetching is switched on
+    std::unique_ptr<HistoryState> projected;
+
+    Tables tables;
+    // targets of the tagged entries, kept apart so that the tag match only touches the entries
+    ArenaArray<Packed, Tables::TABLE_SIZE> targets;
+    ArenaArray<Packed, exp2(BASE_WIDTH)> base;
+    Regions regions;
+    Counter<RESET_WIDTH> success_alloc;
+    Xorshift rng;
+
+    // last prediction
+    bool used_alt;
+    CompEntry provider;
+    CompEntry alter;
+    LookupContext lookup;
+    BranchTarget predicted; // returned by predict
+
+  private:
+    uint64_t getBaseIndex(uint64_t ip)
+    {
+        return ip & bitmask(BASE_WIDTH);
+    }
+
+    Packed &targetOf(const CompEntry &entry, uint64_t ip)
+    {
+        return entry.second ? targets[lookup.pos[entry.first]] : base[getBaseIndex(ip)];
+    }
+
+    // a wrong target is only replaced once its confidence has dropped to 0
+    void updateTarget(const CompEntry &entry, Packed &target, uint64_t actual)
+    {
+        const auto correct = regions.hits(target, actual);
+        if (!correct && entry.second->pred().none())
+            target = regions.pack(actual);
+        else
+            entry.second->updatePred(correct);
+    }
+
+    static bool historyBit(uint64_t target)
+    {
+        return ((target >> PC_SHIFT_AMT) ^ (target >> (PC_SHIFT_AMT + 3))) & 1;
+    }
+
+  public:
+    static constexpr StorageReport storage()
+    {
+        size_t bits = exp2(BASE_WIDTH) * Regions::PACKED_BITS + Regions::MODELLED_BITS + RESET_WIDTH + MAX_HIST_LEN
+                      + PATH_HIST_LEN;
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+            bits += exp2(INDEX_WIDTH[i]) * (CTR_WIDTH + TAG_WIDTH[i] + USEFUL_WIDTH + Regions::PACKED_BITS);
+        const size_t table_bytes = (sizeof(IttageEntry) + sizeof(Packed)) * Tables::TABLE_SIZE;
+        return {bits, table_bytes, sizeof(Ittage) + table_bytes + sizeof(Packed) * exp2(BASE_WIDTH)};
+    }
+
+    explicit Ittage(uint64_t seed = 1) : rng(seed)
+    {
+    }
+
+    const std::string &getName() override
+    {
+        // every parameter shaping the state, so that restore() rejects a snapshot of another config
+        static const std::string name = [] {
+            std::string widths;
+            for (size_t i = 0; i < COMPONENT_NUM; i++)
+                widths += fmt::format("{}{}:{}", i ? " " : "", INDEX_WIDTH[i], TAG_WIDTH[i]);
+            return fmt::format("ITTAGE<{}, {}, {}, {}, {}, {}-{}, [{}], {}, {}, {}, {}>", COMPONENT_NUM, CTR_WIDTH,
+                               USEFUL_WIDTH, BASE_WIDTH, PATH_HIST_LEN, MIN_HIST_LEN, MAX_HIST_LEN, widths,
+                               REGION_NUM, OFFSET_WIDTH, RESET_WIDTH, PC_SHIFT_AMT);
+        }();
+        return name;
+    }
+
+    std::string report() override
+    {
+        constexpr auto budget = storage();
+        return ITargetPredictor::report()
+               + fmt::format("\t storage = {} Kbits modelled, {} KB tables, {} KB resident\n",
+                             budget.modelled_bits / 1024.0, budget.table_bytes / 1024.0, budget.total_bytes / 1024.0);
+    }
+
+    BranchTarget *predict(uint64_t ip) override
+    {
+        ip >>= PC_SHIFT_AMT;
+        tables.hash(history, ip, lookup);
+        const auto match = tables.match(lookup);
+        provider = tables.longestMatch(lookup, match);
+        alter = provider.second ? tables.longestMatch(lookup, match & bitmask(provider.first)) : Tables::NULL_ENTRY;
+
+        // a newly allocated provider is not trusted yet
+        used_alt = !provider.second || provider.second->pred().none();
+        const auto target = targetOf(used_alt ? alter : provider, ip);
+        if (!(target & Regions::VALID))
+            return nullptr;
+        predicted.addr = regions.unpack(target);
+        return &predicted;
+    }
+
+    void update(uint64_t ip, BranchTarget target) override
+    {
+        ip >>= PC_SHIFT_AMT;
+        const auto actual = target.addr;
+        auto &alter_target = targetOf(alter, ip);
+        const auto alter_correct = regions.hits(alter_target, actual);
+        auto correct = alter_correct;
+
+        if (provider.second)
+        {
+            auto &provider_target = targets[lookup.pos[provider.first]];
+            const auto provider_correct = regions.hits(provider_target, actual);
+            if (!used_alt)
+                correct = provider_correct;
+            if (provider_correct != alter_correct)
+                provider.second->updateUseful(provider_correct);
+            updateTarget(provider, provider_target, actual);
+        }
+        if (used_alt)
+        {
+            if (alter.second)
+                updateTarget(alter, alter_target, actual);
+            else
+                alter_target = regions.pack(actual);
+        }
+
+        if (!correct)
+        {
+            const auto packed = regions.pack(actual);
+            const auto start = provider.first + 1 + int(rng.next() & 1);
+            tables.template allocate<1, false>(
+                lookup, start,
+                [this, packed](IttageEntry &entry, uint16_t tag, size_t pos) {
+                    entry.alloc(tag, 0);
+                    targets[pos] = packed;
+                },
+                [this] { success_alloc.update(false); });
+            if (success_alloc.none())
+            {
+                success_alloc.set();
+                tables.age();
+            }
+        }
+
+        history.update(ip, historyBit(actual));
+    }
+
+    void lookaheadBegin()
+    {
+        if (projected)
+            *projected = history;
+        else
+            projected = std::make_unique<HistoryState>(history);
+    }
+
+    // every branch is predicted but only taken ones reach update
+    void lookahead(const BranchRecord &record)
+    {
+        const auto ip = record.ip >> PC_SHIFT_AMT;
+        tables.prefetch(*projected, ip);
+        if (record.taken)
+            projected->update(ip, historyBit(record.target));
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Ittage>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Ittage, false>(records);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        // provider, alter and lookup only live between predict and update, projected within a batch
+        s.raw(history);
+        tables.snapshot(s);
+        s.raw(targets.array());
+        s.raw(base.array());
+        s.raw(regions);
+        s.raw(success_alloc);
+        s.raw(rng);
+    }
+};
+
+#endif
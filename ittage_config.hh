@@ -0,0 +1,21 @@
+#ifndef __ITTAGE_CONFIG_HH__
+#define __ITTAGE_CONFIG_HH__
+#include <array>
+#include <cstddef>
+#include <ratio>
+
+#include "ittage.hh"
+
+template <size_t n>
+using IttageWidthArray = std::array<size_t, n>;
+
+constexpr IttageWidthArray<8> Huge_ittage_index_width = {10, 10, 10, 10, 10, 9, 9, 9};
+constexpr IttageWidthArray<8> Huge_ittage_tag_width = {9, 9, 10, 11, 12, 13, 14, 15};
+using HugeIttage = Ittage<8, 2, 2, 12, 27, 4, std::ratio<19, 10>, Huge_ittage_index_width, Huge_ittage_tag_width, 64,
+                          20, 8>;
+
+constexpr IttageWidthArray<5> L32_ittage_index_width = {8, 8, 8, 7, 7};
+constexpr IttageWidthArray<5> L32_ittage_tag_width = {8, 9, 10, 11, 12};
+using L32Ittage = Ittage<5, 2, 2, 9, 16, 4, std::ratio<2, 1>, L32_ittage_index_width, L32_ittage_tag_width, 16, 18, 6>;
+
+#endif
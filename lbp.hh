@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <fmt/core.h>
 
+#include "arena.hh"
 #include "bp.hh"
 #include "util.hh"
 template <size_t CTR_WIDTH, size_t BHT_WIDTH, size_t HIST_LEN, size_t PC_LEN, size_t PHT_WIDTH,
@@ -14,9 +15,10 @@ class TwoLevelBranchPredictor : public IDirectionPredictor
 {
   private:
     using Ctr = Counter<CTR_WIDTH>;
-    Ctr pht[exp2(PHT_WIDTH)];
+    ArenaArray<Ctr, exp2(PHT_WIDTH)> pht;
 
-    uint64_t bht[exp2(BHT_WIDTH)] = {};
+    ArenaArray<uint64_t, exp2(BHT_WIDTH)> bht;
+    uint64_t projected_history = 0; // the global history at the branch being looked ahead at
     uint64_t getIndex(uint64_t pc, uint64_t history)
     {
         if constexpr (INDEX_ALGO == IndexAlgo::CONCAT)
@@ -34,8 +36,12 @@ class TwoLevelBranchPredictor : public IDirectionPredictor
 
     const std::string &getName() override
     {
-        static const std::string name = BHT_WIDTH ? fmt::format("Local<{}, {}, {}>", BHT_WIDTH, HIST_LEN, PC_LEN)
-                                                  : fmt::format("Global<{}, {}>", HIST_LEN, PHT_WIDTH);
+        // every parameter shaping the state, so that restore() rejects a snapshot of another config
+        static const std::string name =
+            BHT_WIDTH ? fmt::format("Local<{}, {}, {}, {}, {}, {}, {}>", CTR_WIDTH, BHT_WIDTH, HIST_LEN, PC_LEN,
+                                    PHT_WIDTH, indexAlgoName(INDEX_ALGO), PC_SHIFT_AMT)
+                      : fmt::format("Global<{}, {}, {}, {}, {}, {}>", CTR_WIDTH, HIST_LEN, PC_LEN, PHT_WIDTH,
+                                    indexAlgoName(INDEX_ALGO), PC_SHIFT_AMT);
         return name;
     }
 
@@ -52,6 +58,41 @@ class TwoLevelBranchPredictor : public IDirectionPredictor
         pht[getIndex(ip, bht[bht_index])].update(taken);
         bht[bht_index] = (bht[bht_index] << 1) + taken;
     }
+
+    void lookaheadBegin()
+    {
+        projected_history = bht[0];
+    }
+
+    // a global history is projected from the outcomes in the trace, so the pht entry is known in advance
+    // while a local history is only known once its bht entry is read, so only the bht entry is prefetched
+    void lookahead(const BranchRecord &record)
+    {
+        const auto ip = record.ip >> PC_SHIFT_AMT;
+        if constexpr (BHT_WIDTH == 0)
+        {
+            __builtin_prefetch(&pht[getIndex(ip, projected_history)], 1);
+            projected_history = (projected_history << 1) + record.taken;
+        }
+        else
+            __builtin_prefetch(&bht[ip & bitmask(BHT_WIDTH)], 1);
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<TwoLevelBranchPredictor>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<TwoLevelBranchPredictor, false>(records);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        s.raw(pht.array());
+        s.raw(bht.array());
+    }
 };
 
 #endif
@@ -0,0 +1,211 @@
+#ifndef __PERCEPTRON_HH__
+#define __PERCEPTRON_HH__
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <utility>
+
+#include "arena.hh"
+#include "bp.hh"
+#include "history.hh"
+#include "util.hh"
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// sums and trains the weights selected in every table at once
+// weights is one flat int8 table, pos holds the weight selected by each lane; lanes past COUNT select a
+// weight that stays 0
+// the selected weights are kept widened in gathered between the sum and the training
+template <size_t LANES, size_t COUNT, int MIN, int MAX>
+class PerceptronKernel
+{
+    static_assert(LANES % 8 == 0 && COUNT <= LANES);
+
+  public:
+    using Sum = int32_t (*)(const int8_t *weights, const uint32_t *pos, int32_t *gathered);
+    using Train = void (*)(int8_t *weights, const uint32_t *pos, int32_t *gathered, bool taken);
+
+    static int32_t sumScalar(const int8_t *weights, const uint32_t *pos, int32_t *gathered)
+    {
+        int32_t sum = 0;
+        for (size_t i = 0; i < LANES; i++)
+            sum += gathered[i] = weights[pos[i]];
+        return sum;
+    }
+
+    static void trainScalar(int8_t *weights, const uint32_t *pos, int32_t *gathered, bool taken)
+    {
+        for (size_t i = 0; i < COUNT; i++)
+        {
+            gathered[i] = std::clamp(gathered[i] + (taken ? 1 : -1), MIN, MAX);
+            weights[pos[i]] = int8_t(gathered[i]);
+        }
+    }
+
+#ifdef __SSE2__
+    __attribute__((target("avx2"))) static int32_t sumAvx2(const int8_t *weights, const uint32_t *pos,
+                                                            int32_t *gathered)
+    {
+        // plain loads beat vpgatherdd, as in TagMatcher
+        for (size_t i = 0; i < LANES; i++)
+            gathered[i] = weights[pos[i]];
+        auto total = _mm256_setzero_si256();
+        for (size_t i = 0; i < LANES; i += 8)
+            total = _mm256_add_epi32(total, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(gathered + i)));
+        auto half = _mm_add_epi32(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+        half = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+        return _mm_cvtsi128_si32(half);
+    }
+
+    // the saturating steps are vectorized, the weights are written back one by one since there is no
+    // scatter before AVX-512
+    __attribute__((target("avx2"))) static void trainAvx2(int8_t *weights, const uint32_t *pos, int32_t *gathered,
+                                                          bool taken)
+    {
+        const auto step = _mm256_set1_epi32(taken ? 1 : -1);
+        const auto min = _mm256_set1_epi32(MIN);
+        const auto max = _mm256_set1_epi32(MAX);
+        for (size_t i = 0; i < COUNT; i += 8)
+        {
+            auto *lane = reinterpret_cast<__m256i *>(gathered + i);
+            const auto weight = _mm256_add_epi32(_mm256_loadu_si256(lane), step);
+            _mm256_storeu_si256(lane, _mm256_min_epi32(_mm256_max_epi32(weight, min), max));
+        }
+        for (size_t i = 0; i < COUNT; i++)
+            weights[pos[i]] = int8_t(gathered[i]);
+    }
+#endif
+
+    static std::pair<Sum, Train> select()
+    {
+#ifdef __SSE2__
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2"))
+            return {sumAvx2, trainAvx2};
+#endif
+        return {sumScalar, trainScalar};
+    }
+
+    // chosen once by the features of the running cpu
+    inline static const std::pair<Sum, Train> kernel = select();
+};
+
+// hashed perceptron: every table is indexed by the PC hashed with its own segment of the global history
+// and the prediction is the sign of the sum of the selected weights
+template <size_t TABLE_NUM,                             // number of weight tables
+          size_t INDEX_WIDTH,                           // width of the index of every table
+          size_t WEIGHT_WIDTH,                          // width of the weights
+          std::array<size_t, TABLE_NUM> SEGMENT_END,    // table i is hashed with history bits
+                                                        // [SEGMENT_END[i - 1], SEGMENT_END[i]), and table 0
+                                                        // with [0, SEGMENT_END[0]), 0 for a bias table
+          size_t PC_SHIFT_AMT = 2                       // the shift amount of inst pc to discard lowest bits
+          >
+    requires(WEIGHT_WIDTH >= 2 && WEIGHT_WIDTH <= 8)
+class HashedPerceptron : public IDirectionPredictor
+{
+  private:
+    static constexpr size_t SEGMENT_START(const size_t n)
+    {
+        return n ? SEGMENT_END[n - 1] : 0;
+    }
+
+    static constexpr size_t SEGMENT_LEN(const size_t n)
+    {
+        return SEGMENT_END[n] - SEGMENT_START(n);
+    }
+
+    static constexpr size_t MAX_HIST_LEN = SEGMENT_END[TABLE_NUM - 1];
+    static_assert([] {
+        for (size_t i = 0; i < TABLE_NUM; i++)
+            if (SEGMENT_END[i] < SEGMENT_START(i) || SEGMENT_LEN(i) > 64)
+                return false;
+        return true;
+    }());
+
+    static constexpr int WEIGHT_MIN = -int(exp2(WEIGHT_WIDTH - 1));
+    static constexpr int WEIGHT_MAX = int(exp2(WEIGHT_WIDTH - 1)) - 1;
+    // training threshold from the original perceptron paper
+    static constexpr int32_t THETA = int32_t(1.93 * TABLE_NUM + 14);
+
+    static constexpr size_t TABLE_SIZE = exp2(INDEX_WIDTH);
+    static constexpr size_t ZERO_WEIGHT = TABLE_SIZE * TABLE_NUM; // selected by the padding lanes
+    static constexpr size_t LANES = (TABLE_NUM + 7) / 8 * 8;
+    using Kernel = PerceptronKernel<LANES, TABLE_NUM, WEIGHT_MIN, WEIGHT_MAX>;
+
+    // hashes and weights of the current branch, computed once by predict and reused by update
+    struct LookupContext
+    {
+        uint32_t pos[LANES];
+        int32_t weight[LANES];
+        int32_t sum;
+
+        LookupContext()
+        {
+            std::fill(std::begin(pos), std::end(pos), ZERO_WEIGHT);
+        }
+    };
+
+  private:
+    ArenaArray<int8_t, ZERO_WEIGHT + 1> weights; // the tables back to back, then the zero weight
+    History<std::max<size_t>(MAX_HIST_LEN, 1)> global_history;
+    LookupContext lookup;
+
+    template <size_t... T>
+    void hashTables(uint64_t ip, std::index_sequence<T...>)
+    {
+        ((lookup.pos[T] = T * TABLE_SIZE
+                          + getXoredIndex<64 - PC_SHIFT_AMT, SEGMENT_LEN(T), INDEX_WIDTH>(
+                              ip, global_history.segment(SEGMENT_START(T), SEGMENT_LEN(T)))),
+         ...);
+    }
+
+  public:
+    const std::string &getName() override
+    {
+        static const std::string name =
+            fmt::format("HashedPerceptron<{}, {}, {}, {}>", TABLE_NUM, INDEX_WIDTH, WEIGHT_WIDTH, MAX_HIST_LEN);
+        return name;
+    }
+
+    bool predict(uint64_t ip) override
+    {
+        ip >>= PC_SHIFT_AMT;
+        hashTables(ip, std::make_index_sequence<TABLE_NUM>());
+        lookup.sum = Kernel::kernel.first(weights.data(), lookup.pos, lookup.weight);
+        return lookup.sum >= 0;
+    }
+
+    void update(uint64_t, bool taken) override
+    {
+        // only trained on a misprediction or when the sum is not confident enough
+        if ((lookup.sum >= 0) != taken || std::abs(lookup.sum) <= THETA)
+            Kernel::kernel.second(weights.data(), lookup.pos, lookup.weight, taken);
+        global_history.push(taken);
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<HashedPerceptron>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<HashedPerceptron, false>(records);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        // lookup only lives between predict and update
+        s.raw(weights.array());
+        s.raw(global_history);
+    }
+};
+
+#endif
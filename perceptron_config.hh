@@ -0,0 +1,18 @@
+#ifndef __PERCEPTRON_CONFIG_HH__
+#define __PERCEPTRON_CONFIG_HH__
+#include <array>
+#include <cstddef>
+
+#include "perceptron.hh"
+
+template <size_t n>
+using SegmentArray = std::array<size_t, n>;
+
+// a bias table followed by segments growing roughly geometrically
+constexpr SegmentArray<16> Huge_segment_end = {0, 3, 6, 10, 15, 21, 28, 37, 48, 61, 77, 96, 119, 147, 180, 220};
+using HugePerceptron = HashedPerceptron<16, 12, 8, Huge_segment_end>; // 64 KB of weights
+
+constexpr SegmentArray<8> L32_segment_end = {0, 4, 9, 16, 26, 40, 58, 80};
+using L32Perceptron = HashedPerceptron<8, 9, 8, L32_segment_end>; // 4 KB of weights
+
+#endif
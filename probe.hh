@@ -0,0 +1,172 @@
+#ifndef __PROBE_HH__
+#define __PROBE_HH__
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <fmt/core.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "util.hh"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// timestamps of the stage probes: the time stamp counter where there is one, nanoseconds otherwise
+#if defined(__x86_64__) || defined(__i386__)
+constexpr std::string_view PROBE_UNIT = "cycles";
+
+inline uint64_t probeClock()
+{
+    return __rdtsc();
+}
+#else
+constexpr std::string_view PROBE_UNIT = "ns";
+
+inline uint64_t probeClock()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return uint64_t(now.tv_sec) * 1'000'000'000 + now.tv_nsec;
+}
+#endif
+
+// log2 histograms of the durations of every stage, bucket b counts durations in [2^(b-1), 2^b)
+template <size_t STAGE_NUM>
+struct StageHistograms
+{
+    static constexpr size_t BUCKET_NUM = 65;
+
+    uint64_t buckets[STAGE_NUM][BUCKET_NUM] = {};
+    uint64_t count[STAGE_NUM] = {};
+    uint64_t total[STAGE_NUM] = {};
+
+    void record(size_t stage, uint64_t ticks)
+    {
+        buckets[stage][std::bit_width(ticks)]++;
+        count[stage]++;
+        total[stage] += ticks;
+    }
+
+    void merge(const StageHistograms &other)
+    {
+        for (size_t s = 0; s < STAGE_NUM; s++)
+        {
+            for (size_t b = 0; b < BUCKET_NUM; b++)
+                buckets[s][b] += other.buckets[s][b];
+            count[s] += other.count[s];
+            total[s] += other.total[s];
+        }
+    }
+
+    // upper bound of the q quantile of a stage
+    uint64_t quantile(size_t stage, double q) const
+    {
+        const auto rank = uint64_t(q * count[stage]);
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKET_NUM; b++)
+            if ((seen += buckets[stage][b]) > rank)
+                return b < 64 ? exp2(b) : UINT64_MAX;
+        return 0;
+    }
+};
+
+// stage timings of every predictor of type Owner
+// every thread records into histograms of its own, without synchronization, which report merges;
+// report is meant to be read once the runs are over
+template <typename Owner, size_t STAGE_NUM>
+class StageProbes
+{
+  public:
+    using Histograms = StageHistograms<STAGE_NUM>;
+
+  private:
+    struct Registry
+    {
+        std::mutex lock;
+        std::vector<std::unique_ptr<Histograms>> threads; // outlive their threads
+    };
+
+    static Registry &registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+  public:
+    static Histograms &local()
+    {
+        thread_local Histograms *histograms = [] {
+            auto &registry = StageProbes::registry();
+            std::lock_guard guard(registry.lock);
+            return registry.threads.emplace_back(std::make_unique<Histograms>()).get();
+        }();
+        return *histograms;
+    }
+
+    static Histograms merged()
+    {
+        auto &registry = StageProbes::registry();
+        std::lock_guard guard(registry.lock);
+        Histograms histograms;
+        for (const auto &thread : registry.threads)
+            histograms.merge(*thread);
+        return histograms;
+    }
+
+    static std::string report(const std::array<std::string_view, STAGE_NUM> &names)
+    {
+        const auto histograms = merged();
+        std::string report = fmt::format("\t stage timings in {}:\n", PROBE_UNIT);
+        for (size_t s = 0; s < STAGE_NUM; s++)
+        {
+            const auto count = histograms.count[s];
+            report += fmt::format("\t   {:<12} {:>12} probes, mean {:>8.1f}, p50 < {}, p90 < {}, p99 < {}\n", names[s],
+                                  count, count ? double(histograms.total[s]) / count : 0.0,
+                                  histograms.quantile(s, 0.5), histograms.quantile(s, 0.9),
+                                  histograms.quantile(s, 0.99));
+        }
+        return report;
+    }
+};
+
+// times its scope as one sample of stage, and compiles to nothing when not ENABLED
+template <typename Probes, bool ENABLED>
+class ScopedProbe
+{
+  private:
+    const size_t stage;
+    const uint64_t begin;
+
+  public:
+    explicit ScopedProbe(size_t stage) : stage(stage), begin(probeClock())
+    {
+    }
+
+    ScopedProbe(const ScopedProbe &) = delete;
+    ScopedProbe &operator=(const ScopedProbe &) = delete;
+
+    ~ScopedProbe()
+    {
+        Probes::local().record(stage, probeClock() - begin);
+    }
+};
+
+template <typename Probes>
+class ScopedProbe<Probes, false>
+{
+  public:
+    explicit ScopedProbe(size_t)
+    {
+    }
+};
+
+#endif
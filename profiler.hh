@@ -0,0 +1,243 @@
+#ifndef __PROFILER_HH__
+#define __PROFILER_HH__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "util.hh"
+
+// number of ips tracked by the misprediction profiler of every direction predictor, 0 compiles it out
+// e.g. -DBP_MISPREDICT_PROFILE=1024
+#ifndef BP_MISPREDICT_PROFILE
+#define BP_MISPREDICT_PROFILE 0
+#endif
+
+// heavy hitters of a stream of ips in fixed memory, by the Space-Saving algorithm: CAPACITY ips are
+// monitored, and an unmonitored ip replaces the one with the smallest count, inheriting that count as
+// its error
+// every ip seen more than total / CAPACITY times is monitored, and its true count lies in
+// [count - error, count]
+template <size_t CAPACITY>
+    requires(CAPACITY > 0 && CAPACITY < UINT32_MAX)
+class SpaceSaving
+{
+  public:
+    struct HeavyHitter
+    {
+        uint64_t ip;
+        uint64_t count; // upper bound of the true count
+        uint64_t error; // count - error is a lower bound
+    };
+
+  private:
+    static constexpr size_t HASH_SIZE = exp2(size_t(lg2(CAPACITY * 2 - 1) + 1));
+    static constexpr uint32_t EMPTY = 0;
+
+    HeavyHitter slots[CAPACITY];
+    uint32_t heap[CAPACITY];   // slots ordered as a min-heap on count
+    uint32_t where[CAPACITY];  // position of every slot in heap
+    uint32_t hash[HASH_SIZE] = {}; // ip to slot + 1 by linear probing
+    size_t size = 0;
+    uint64_t total = 0;
+
+    static size_t home(uint64_t ip)
+    {
+        // fibonacci hashing, the low bits of ips are mostly aligned
+        return (ip * 0x9e3779b97f4a7c15ull) >> (64 - lg2(HASH_SIZE));
+    }
+
+    size_t probe(uint64_t ip) const
+    {
+        auto pos = home(ip);
+        while (hash[pos] != EMPTY && slots[hash[pos] - 1].ip != ip)
+            pos = (pos + 1) % HASH_SIZE;
+        return pos;
+    }
+
+    // backward shift deletion keeps every probe sequence unbroken
+    void unhash(uint64_t ip)
+    {
+        auto hole = probe(ip);
+        hash[hole] = EMPTY;
+        for (auto pos = (hole + 1) % HASH_SIZE; hash[pos] != EMPTY; pos = (pos + 1) % HASH_SIZE)
+        {
+            const auto want = home(slots[hash[pos] - 1].ip);
+            // move the entry into the hole unless its home lies cyclically in (hole, pos]
+            if ((pos - want) % HASH_SIZE >= (pos - hole) % HASH_SIZE)
+            {
+                hash[hole] = hash[pos];
+                hash[pos] = EMPTY;
+                hole = pos;
+            }
+        }
+    }
+
+    void swapHeap(size_t a, size_t b)
+    {
+        std::swap(heap[a], heap[b]);
+        where[heap[a]] = a;
+        where[heap[b]] = b;
+    }
+
+    void siftDown(size_t pos)
+    {
+        for (;;)
+        {
+            auto smallest = pos;
+            for (auto child = 2 * pos + 1; child <= 2 * pos + 2 && child < size; child++)
+                if (slots[heap[child]].count < slots[heap[smallest]].count)
+                    smallest = child;
+            if (smallest == pos)
+                return;
+            swapHeap(pos, smallest);
+            pos = smallest;
+        }
+    }
+
+    void siftUp(size_t pos)
+    {
+        for (; pos && slots[heap[pos]].count < slots[heap[(pos - 1) / 2]].count; pos = (pos - 1) / 2)
+            swapHeap(pos, (pos - 1) / 2);
+    }
+
+  public:
+    void record(uint64_t ip)
+    {
+        total++;
+        const auto pos = probe(ip);
+        if (hash[pos] != EMPTY)
+        {
+            const auto slot = hash[pos] - 1;
+            slots[slot].count++;
+            siftDown(where[slot]);
+            return;
+        }
+        if (size < CAPACITY)
+        {
+            slots[size] = {ip, 1, 0};
+            heap[size] = where[size] = size;
+            hash[pos] = ++size;
+            siftUp(size - 1);
+            return;
+        }
+        // replace the least counted ip
+        const auto slot = heap[0];
+        unhash(slots[slot].ip);
+        const auto min = slots[slot].count;
+        slots[slot] = {ip, min + 1, min};
+        hash[probe(ip)] = slot + 1;
+        siftDown(0);
+    }
+
+    // the summary of this stream followed by other, with the same guarantees: an ip missing from a
+    // full summary may have been seen as often as its least counted ip
+    void merge(const SpaceSaving &other)
+    {
+        const auto floor = [](const SpaceSaving &s) { return s.size == CAPACITY ? s.slots[s.heap[0]].count : 0; };
+        const auto mine = floor(*this), theirs = floor(other);
+        std::vector<HeavyHitter> hitters(slots, slots + size);
+        for (auto &hitter : hitters)
+        {
+            const auto pos = other.probe(hitter.ip);
+            const auto add = other.hash[pos] != EMPTY ? other.slots[other.hash[pos] - 1] : HeavyHitter{0, theirs, theirs};
+            hitter.count += add.count;
+            hitter.error += add.error;
+        }
+        for (size_t i = 0; i < other.size; i++)
+            if (hash[probe(other.slots[i].ip)] == EMPTY)
+                hitters.push_back({other.slots[i].ip, other.slots[i].count + mine, other.slots[i].error + mine});
+
+        // keep the CAPACITY most counted and rebuild the hash and the heap over them
+        const auto n = std::min(CAPACITY, hitters.size());
+        std::nth_element(hitters.begin(), hitters.begin() + n, hitters.end(),
+                         [](const auto &a, const auto &b) { return a.count > b.count; });
+        std::fill(std::begin(hash), std::end(hash), EMPTY);
+        for (size = 0; size < n; size++)
+        {
+            slots[size] = hitters[size];
+            heap[size] = where[size] = size;
+            hash[probe(slots[size].ip)] = size + 1;
+        }
+        for (auto pos = size / 2; pos-- > 0;)
+            siftDown(pos);
+        total += other.total;
+    }
+
+    uint64_t recorded() const
+    {
+        return total;
+    }
+
+    // the top monitored ips by count
+    std::vector<HeavyHitter> top(size_t n) const
+    {
+        std::vector<HeavyHitter> hitters(slots, slots + size);
+        n = std::min(n, hitters.size());
+        std::partial_sort(hitters.begin(), hitters.begin() + n, hitters.end(),
+                          [](const auto &a, const auto &b) { return a.count > b.count; });
+        hitters.resize(n);
+        return hitters;
+    }
+};
+
+// the static branches causing the most mispredictions
+template <size_t CAPACITY>
+class MispredictProfiler
+{
+  private:
+    SpaceSaving<CAPACITY> sketch;
+
+  public:
+    static constexpr bool ENABLED = true;
+
+    void record(uint64_t ip)
+    {
+        sketch.record(ip);
+    }
+
+    // the profile of this run followed by other, e.g. the next chunk of a trace
+    void merge(const MispredictProfiler &other)
+    {
+        sketch.merge(other.sketch);
+    }
+
+    std::string report(size_t top = 20) const
+    {
+        const auto total = sketch.recorded();
+        auto report = fmt::format("\t top mispredicting branches of {} mispredictions:\n", total);
+        for (const auto &hitter : sketch.top(top))
+            report += fmt::format("\t   {:#x}: {} (-{}) = {:.3f}%\n", hitter.ip, hitter.count, hitter.error,
+                                  100.0 * hitter.count / total);
+        return report;
+    }
+};
+
+// what the profiler compiles to when disabled
+struct DisabledProfiler
+{
+    static constexpr bool ENABLED = false;
+
+    void record(uint64_t)
+    {
+    }
+
+    void merge(const DisabledProfiler &)
+    {
+    }
+
+    std::string report(size_t = 0) const
+    {
+        return "";
+    }
+};
+
+using DirectionProfiler = std::conditional_t<BP_MISPREDICT_PROFILE != 0,
+                                             MispredictProfiler<std::max(BP_MISPREDICT_PROFILE, 1)>, DisabledProfiler>;
+
+#endif
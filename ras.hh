@@ -59,6 +59,22 @@ class Ras : public ICallReturnPredictor
             top->addr = addr;
         }
     }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Ras>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Ras, false>(records);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        s.raw(stack);
+        s.pointer(top, stack);
+    }
 };
 
 #endif
@@ -0,0 +1,112 @@
+#ifndef __SAMPLING_HH__
+#define __SAMPLING_HH__
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fmt/core.h>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bp.hh"
+#include "engine.hh"
+
+struct SampleEstimate
+{
+    double accuracy;     // ratio of all measured correct predictions to all measured predictions
+    double half_width;   // of the confidence interval around accuracy
+    size_t interval_num; // measured intervals holding at least one prediction
+    uint64_t measured;   // records simulated in detail
+    uint64_t total;      // records in the trace
+
+    std::string report(const std::string &name) const
+    {
+        return fmt::format("{} sampled accuracy = {}% +- {}% ({} intervals, {} / {} records measured)\n", name,
+                           accuracy * 100, half_width * 100, interval_num, measured, total);
+    }
+};
+
+// alternates fast-forward regions with detailed intervals and estimates the full-trace accuracy
+// from the per-interval accuracies; the predictor is warmed (see IPredictor::warmBatch) through the last
+// warming records of every fast-forward region, by default the whole region, and the records before
+// only advance its histories (see IPredictor::skipBatch), so that no interval starts from a stale history
+class SampledSimulation
+{
+  private:
+    uint64_t fast_forward; // records before every interval
+    uint64_t interval;     // records measured in every interval
+    uint64_t warming;      // records warmed at the end of every fast-forward region
+    double z;              // of the confidence level, 1.96 for 95%
+
+  public:
+    SampledSimulation(uint64_t fast_forward, uint64_t interval, uint64_t warming = UINT64_MAX, double z = 1.96)
+        : fast_forward(fast_forward), interval(interval), warming(std::min(warming, fast_forward)), z(z)
+    {
+        assert(interval > 0);
+    }
+
+    SampleEstimate run(IPredictor &predictor, const BatchSource &source) const
+    {
+        const auto period = fast_forward + interval;
+        const auto skip_end = fast_forward - warming;
+        std::vector<Accuracy> samples;
+        uint64_t position = 0;
+        auto last = predictor.accuracy();
+        auto close = [&] {
+            const auto now = predictor.accuracy();
+            if (now.total != last.total)
+                samples.push_back({now.correct - last.correct, now.total - last.total});
+            last = now;
+        };
+
+        for (auto records = source(); !records.empty(); records = source())
+        {
+            while (!records.empty())
+            {
+                const auto offset = position % period;
+                const auto end = offset < skip_end ? skip_end : offset < fast_forward ? fast_forward : period;
+                const auto part = records.first(std::min<uint64_t>(end - offset, records.size()));
+                if (offset >= fast_forward)
+                    predictor.checkPredBatch(part);
+                else if (offset >= skip_end)
+                    predictor.warmBatch(part);
+                else
+                    predictor.skipBatch(part);
+                position += part.size();
+                records = records.subspan(part.size());
+                if (end == period && position % period == 0)
+                    close();
+            }
+        }
+        close(); // the trailing partial interval
+
+        // ratio estimator with the variance of the per-interval accuracies weighted by their sizes
+        SampleEstimate estimate = {0, 0, samples.size(), 0, position};
+        uint64_t correct = 0, total = 0;
+        for (const auto &sample : samples)
+        {
+            correct += sample.correct;
+            total += sample.total;
+        }
+        estimate.accuracy = total ? double(correct) / total : 0;
+        estimate.measured = position / period * interval + (std::max(position % period, fast_forward) - fast_forward);
+        if (samples.size() > 1)
+        {
+            const double mean_size = double(total) / samples.size();
+            double variance = 0;
+            for (const auto &sample : samples)
+            {
+                const auto residual = sample.correct - estimate.accuracy * sample.total;
+                variance += residual * residual;
+            }
+            variance /= (samples.size() - 1) * mean_size * mean_size * samples.size();
+            estimate.half_width = z * std::sqrt(variance);
+        }
+        return estimate;
+    }
+};
+
+#endif
@@ -0,0 +1,161 @@
+#ifndef __SNAPSHOT_HH__
+#define __SNAPSHOT_HH__
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+// predictor state is walked by a single snapshot() method for both directions:
+// every section is saved from, or restored into, the referenced object as raw bytes
+class Snapshot
+{
+  public:
+    virtual ~Snapshot() = default;
+
+    virtual void bytes(void *data, size_t size) = 0;
+
+    template <typename T>
+        requires(std::is_trivially_copyable_v<T>)
+    void raw(T &obj)
+    {
+        bytes(&obj, sizeof(obj));
+    }
+
+    // pointers into the predictor itself are stored as offsets
+    template <typename T, size_t N>
+    void pointer(T *&ptr, T (&base)[N])
+    {
+        uint64_t offset = ptr - base;
+        raw(offset);
+        if (offset >= N)
+            throw std::runtime_error("corrupted snapshot");
+        ptr = base + offset;
+    }
+};
+
+// file layout: a SnapshotHeader, the predictor name, then the raw sections in snapshot() order
+struct SnapshotHeader
+{
+    static constexpr char MAGIC[8] = "BPSNAP";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t name_size;
+    uint64_t state_size;
+};
+
+class SnapshotWriter : public Snapshot
+{
+  private:
+    std::vector<uint8_t> state;
+
+  public:
+    void bytes(void *data, size_t size) override
+    {
+        const auto *begin = static_cast<const uint8_t *>(data);
+        state.insert(state.end(), begin, begin + size);
+    }
+
+    void write(const std::string &path, const std::string &name)
+    {
+        SnapshotHeader header = {};
+        std::memcpy(header.magic, SnapshotHeader::MAGIC, sizeof(header.magic));
+        header.version = SnapshotHeader::VERSION;
+        header.name_size = name.size();
+        header.state_size = state.size();
+
+        FILE *file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            throw std::system_error(errno, std::generic_category(), fmt::format("failed to create snapshot {}", path));
+        const bool written = std::fwrite(&header, sizeof(header), 1, file) == 1
+                             && std::fwrite(name.data(), 1, name.size(), file) == name.size()
+                             && std::fwrite(state.data(), 1, state.size(), file) == state.size();
+        if (std::fclose(file) || !written)
+            throw std::system_error(errno, std::generic_category(), fmt::format("failed to write snapshot {}", path));
+    }
+};
+
+// restores by copying straight out of the mapped snapshot, nothing is parsed
+class SnapshotReader : public Snapshot
+{
+  private:
+    void *mapping = MAP_FAILED;
+    size_t mapping_size = 0;
+    const uint8_t *cursor = nullptr;
+    const uint8_t *end = nullptr;
+    std::string name;
+
+  public:
+    explicit SnapshotReader(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), fmt::format("failed to open snapshot {}", path));
+        struct stat st;
+        if (::fstat(fd, &st) || st.st_size < off_t(sizeof(SnapshotHeader)))
+        {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("invalid snapshot {}", path));
+        }
+        mapping_size = st.st_size;
+        mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            throw std::system_error(errno, std::generic_category(), fmt::format("failed to map snapshot {}", path));
+
+        const auto *header = static_cast<const SnapshotHeader *>(mapping);
+        if (std::memcmp(header->magic, SnapshotHeader::MAGIC, sizeof(header->magic))
+            || header->version != SnapshotHeader::VERSION
+            || header->name_size + header->state_size != mapping_size - sizeof(SnapshotHeader))
+        {
+            ::munmap(mapping, mapping_size);
+            throw std::runtime_error(fmt::format("invalid snapshot {}", path));
+        }
+        const auto *name_begin = reinterpret_cast<const char *>(header + 1);
+        name.assign(name_begin, header->name_size);
+        cursor = reinterpret_cast<const uint8_t *>(name_begin + header->name_size);
+        end = cursor + header->state_size;
+    }
+
+    SnapshotReader(const SnapshotReader &) = delete;
+    SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+    ~SnapshotReader()
+    {
+        if (mapping != MAP_FAILED)
+            ::munmap(mapping, mapping_size);
+    }
+
+    const std::string &getName() const
+    {
+        return name;
+    }
+
+    bool exhausted() const
+    {
+        return cursor == end;
+    }
+
+    void bytes(void *data, size_t size) override
+    {
+        if (size_t(end - cursor) < size)
+            throw std::runtime_error("snapshot does not match the predictor");
+        std::memcpy(data, cursor, size);
+        cursor += size;
+    }
+};
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef __SWEEP_HH__
+#define __SWEEP_HH__
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fmt/core.h>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "arena.hh"
+#include "bp.hh"
+#include "compressed_trace.hh"
+#include "engine.hh"
+#include "trace.hh"
+
+struct PredictorFactory
+{
+    std::string name;
+    std::function<std::unique_ptr<IPredictor>()> create;
+    double cost = 1; // relative time per branch, used to schedule the longest jobs first
+};
+
+template <typename P>
+void registerPredictor(std::vector<PredictorFactory> &registry, std::string name, double cost = 1)
+{
+    registry.push_back({std::move(name), [] { return std::make_unique<P>(); }, cost});
+}
+
+// runs every (trace, predictor) pair on a work-stealing pool, longest estimated jobs first
+// each finished job is appended to a results file as a tab-separated line:
+//     <trace> <predictor> <seconds> <report with newlines replaced by " | ">
+// pairs already present in the results file are skipped, so an interrupted sweep resumes where it stopped
+class SweepRunner
+{
+  private:
+    struct Job
+    {
+        size_t trace;
+        size_t config;
+        double cost;
+    };
+
+    struct Worker
+    {
+        std::mutex lock;
+        std::deque<Job> jobs; // sorted from the longest
+    };
+
+    std::vector<std::string> traces;
+    std::vector<PredictorFactory> registry;
+    std::string results_path;
+    FILE *results = nullptr;
+    std::mutex results_lock;
+
+    static std::string escape(std::string text)
+    {
+        while (!text.empty() && text.back() == '\n')
+            text.pop_back();
+        std::string escaped;
+        for (const auto c : text)
+        {
+            if (c == '\n')
+                escaped += " | ";
+            else
+                escaped += c == '\t' ? ' ' : c;
+        }
+        return escaped;
+    }
+
+    // drop a partially written last line and collect the finished pairs
+    std::set<std::pair<std::string, std::string>> loadFinished()
+    {
+        std::set<std::pair<std::string, std::string>> finished;
+        std::ifstream in(results_path, std::ios::binary);
+        if (!in)
+            return finished;
+        const std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+
+        const auto complete = content.rfind('\n') == std::string::npos ? 0 : content.rfind('\n') + 1;
+        if (complete != content.size())
+            std::filesystem::resize_file(results_path, complete);
+
+        std::istringstream lines(content.substr(0, complete));
+        for (std::string line; std::getline(lines, line);)
+        {
+            const auto first = line.find('\t');
+            const auto second = first == std::string::npos ? first : line.find('\t', first + 1);
+            if (second != std::string::npos)
+                finished.emplace(line.substr(0, first), line.substr(first + 1, second - first - 1));
+        }
+        return finished;
+    }
+
+    void record(const Job &job, double seconds, const std::string &report)
+    {
+        const auto line = fmt::format("{}\t{}\t{:.3f}\t{}\n", traces[job.trace], registry[job.config].name, seconds,
+                                      escape(report));
+        std::lock_guard guard(results_lock);
+        std::fwrite(line.data(), line.size(), 1, results);
+        std::fflush(results);
+    }
+
+    void execute(const Job &job)
+    {
+        auto predictor = registry[job.config].create();
+        const auto begin = std::chrono::steady_clock::now();
+        readTrace(traces[job.trace], [&predictor](auto batch) { predictor->checkPredBatch(batch); });
+        const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        record(job, seconds, predictor->report());
+    }
+
+    static bool take(Worker &worker, Job &job, bool steal)
+    {
+        std::lock_guard guard(worker.lock);
+        if (worker.jobs.empty())
+            return false;
+        if (steal)
+        {
+            job = worker.jobs.back();
+            worker.jobs.pop_back();
+        }
+        else
+        {
+            job = worker.jobs.front();
+            worker.jobs.pop_front();
+        }
+        return true;
+    }
+
+    void work(std::vector<Worker> &workers, size_t self)
+    {
+        // the tables of the predictors of this worker stay on the NUMA node it is pinned to
+        Arena arena(cpuNode(self));
+        ArenaScope scope(arena);
+        for (Job job;;)
+        {
+            bool found = take(workers[self], job, false);
+            for (size_t i = 1; !found && i < workers.size(); i++)
+                found = take(workers[(self + i) % workers.size()], job, true);
+            if (!found)
+                return; // no job is ever added, so nothing is left anywhere
+            try
+            {
+                execute(job);
+            }
+            catch (const std::exception &e)
+            {
+                // left out of the results so that the next run retries it
+                fmt::print(stderr, "{} on {} failed: {}\n", registry[job.config].name, traces[job.trace], e.what());
+            }
+        }
+    }
+
+  public:
+    SweepRunner(std::vector<std::string> traces, std::vector<PredictorFactory> registry, std::string results_path)
+        : traces(std::move(traces)), registry(std::move(registry)), results_path(std::move(results_path))
+    {
+    }
+
+    // returns the number of jobs run, excluding those already in the results file
+    size_t run(size_t thread_num = 0)
+    {
+        const auto finished = loadFinished();
+        std::vector<Job> jobs;
+        for (size_t t = 0; t < traces.size(); t++)
+        {
+            std::error_code ec;
+            const auto trace_size = std::filesystem::file_size(traces[t], ec);
+            for (size_t c = 0; c < registry.size(); c++)
+                if (!finished.contains({traces[t], registry[c].name}))
+                    jobs.push_back({t, c, (ec ? 1 : trace_size) * registry[c].cost});
+        }
+        std::stable_sort(jobs.begin(), jobs.end(), [](const Job &a, const Job &b) { return a.cost > b.cost; });
+
+        thread_num = std::clamp<size_t>(thread_num ? thread_num : std::thread::hardware_concurrency(), 1,
+                                        std::max<size_t>(1, jobs.size()));
+        std::vector<Worker> workers(thread_num);
+        for (size_t i = 0; i < jobs.size(); i++)
+            workers[i % thread_num].jobs.push_back(jobs[i]);
+
+        results = std::fopen(results_path.c_str(), "ab");
+        if (!results)
+            throw traceError("failed to open results", results_path);
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < thread_num; i++)
+        {
+            threads.emplace_back(&SweepRunner::work, this, std::ref(workers), i);
+            pinThread(threads.back(), i);
+        }
+        for (auto &thread : threads)
+            thread.join();
+        std::fclose(std::exchange(results, nullptr));
+        return jobs.size();
+    }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef __TAG_MATCH_HH__
+#define __TAG_MATCH_HH__
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+// compares the tags of the entries probed in every component at once
+// entries are 32-bit words holding the tag at TAG_SHIFT, pos holds the word index probed by each lane
+// and tags the expected tags; both are padded to LANES with lanes that never match
+// bit i of the returned mask is set if lane i matches
+template <size_t LANES, size_t TAG_SHIFT, uint32_t TAG_MASK>
+class TagMatcher
+{
+    static_assert(LANES % 16 == 0 && LANES <= 32);
+    static_assert(TAG_MASK != UINT32_MAX); // the padding tag
+
+  public:
+    static constexpr uint32_t PAD_TAG = UINT32_MAX;
+
+    using Kernel = uint32_t (*)(const uint32_t *entries, const uint32_t *pos, const uint32_t *tags);
+
+    static uint32_t matchScalar(const uint32_t *entries, const uint32_t *pos, const uint32_t *tags)
+    {
+        uint32_t mask = 0;
+        for (size_t i = 0; i < LANES; i++)
+            mask |= uint32_t(((entries[pos[i]] >> TAG_SHIFT) & TAG_MASK) == tags[i]) << i;
+        return mask;
+    }
+
+#ifdef __SSE2__
+    // the lanes are filled with plain loads: hardware gathers are microcoded and slower than
+    // LANES independent loads on current cores, only the compare is worth vectorizing
+    static void load(const uint32_t *entries, const uint32_t *pos, uint32_t *words)
+    {
+        for (size_t i = 0; i < LANES; i++)
+            words[i] = entries[pos[i]];
+    }
+
+    static uint32_t matchSse(const uint32_t *entries, const uint32_t *pos, const uint32_t *tags)
+    {
+        alignas(16) uint32_t words[LANES];
+        load(entries, pos, words);
+        const auto tag_mask = _mm_set1_epi32(TAG_MASK);
+        uint32_t mask = 0;
+        for (size_t i = 0; i < LANES; i += 4)
+        {
+            const auto stored = _mm_and_si128(
+                _mm_srli_epi32(_mm_load_si128(reinterpret_cast<const __m128i *>(words + i)), TAG_SHIFT), tag_mask);
+            const auto equal = _mm_cmpeq_epi32(stored, _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags + i)));
+            mask |= uint32_t(_mm_movemask_ps(_mm_castsi128_ps(equal))) << i;
+        }
+        return mask;
+    }
+
+    __attribute__((target("avx2"))) static uint32_t matchAvx2(const uint32_t *entries, const uint32_t *pos,
+                                                               const uint32_t *tags)
+    {
+        alignas(32) uint32_t words[LANES];
+        load(entries, pos, words);
+        const auto tag_mask = _mm256_set1_epi32(TAG_MASK);
+        uint32_t mask = 0;
+        for (size_t i = 0; i < LANES; i += 8)
+        {
+            const auto stored = _mm256_and_si256(
+                _mm256_srli_epi32(_mm256_load_si256(reinterpret_cast<const __m256i *>(words + i)), TAG_SHIFT),
+                tag_mask);
+            const auto equal =
+                _mm256_cmpeq_epi32(stored, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags + i)));
+            mask |= uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(equal))) << i;
+        }
+        return mask;
+    }
+
+    __attribute__((target("avx512f"))) static uint32_t matchAvx512(const uint32_t *entries, const uint32_t *pos,
+                                                                   const uint32_t *tags)
+    {
+        alignas(64) uint32_t words[LANES];
+        load(entries, pos, words);
+        const auto tag_mask = _mm512_set1_epi32(TAG_MASK);
+        uint32_t mask = 0;
+        for (size_t i = 0; i < LANES; i += 16)
+        {
+            const auto stored = _mm512_and_si512(_mm512_srli_epi32(_mm512_load_si512(words + i), TAG_SHIFT), tag_mask);
+            mask |= uint32_t(_mm512_cmpeq_epi32_mask(stored, _mm512_loadu_si512(tags + i))) << i;
+        }
+        return mask;
+    }
+#endif
+
+    static Kernel select()
+    {
+#ifdef __SSE2__
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f"))
+            return matchAvx512;
+        if (__builtin_cpu_supports("avx2"))
+            return matchAvx2;
+        return matchSse;
+#else
+        return matchScalar;
+#endif
+    }
+
+    // chosen once by the features of the running cpu
+    inline static const Kernel match = select();
+};
+
+#endif
@@ -3,16 +3,19 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <concepts>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
-#include <random>
+#include <memory>
 #include <ratio>
 
 #include "bimodal.hh"
 #include "bp.hh"
+#include "probe.hh"
+#include "tage_components.hh"
 #include "util.hh"
 
 enum class AllocCond
@@ -25,8 +28,20 @@ enum class AllocCond
     FINAL_MISPRED
 };
 
-template <typename T>
-concept ratioSpec = std::same_as<T, std::ratio<T::num, T::den>>;
+constexpr std::string_view allocCondName(AllocCond cond)
+{
+    switch (cond)
+    {
+    case AllocCond::ALL_MISPRED:
+        return "ALL_MISPRED";
+    case AllocCond::LONGEST_MISPRED:
+        return "LONGEST_MISPRED";
+    case AllocCond::FINAL_MISPRED:
+        return "FINAL_MISPRED";
+    }
+    return "";
+}
+
 template <size_t COMPONENT_NUM,                          // number of predictor components
           size_t CTR_WIDTH,                              // width of prediction counters
           size_t USEFUL_WIDTH,                           // width of useful counters
@@ -54,60 +69,51 @@ template <size_t COMPONENT_NUM,                          // number of predictor
                                                          // counter, the width of the counter
                                                          // false - branch counter, the width
                                                          // of the counter
-          size_t PC_SHIFT_AMT = 2                        // the shift amount of inst pc to discard lowest bits
+          size_t PC_SHIFT_AMT = 2,                       // the shift amount of inst pc to discard lowest bits
+          bool PROBE_STAGES = false                      // time the stages of predict and update, see probes()
           >
 class Tage : public IDirectionPredictor
 {
   private:
-    static constexpr size_t HIST_LEN(const int n)
-    {
-        auto power = 1.0;
-        for (auto i = 0; i <= n; i++)
-            power *= double(HIST_ALPHA::num) / HIST_ALPHA::den;
-        return size_t(MIN_HIST_LEN * power + 0.5);
-    }
-    static constexpr size_t MAX_HIST_LEN = HIST_LEN(COMPONENT_NUM - 1);
-    // we use the formula according to the original paper
-    // since manually optimized set of history lengths leads to a limited benefits
-    // (<0.5%)
+    static constexpr auto HIST_LEN = geometricHistLen<COMPONENT_NUM, MIN_HIST_LEN, HIST_ALPHA>();
+    static constexpr size_t MAX_HIST_LEN = HIST_LEN[COMPONENT_NUM - 1];
 
-    static constexpr size_t MAX_INDEX_WIDTH = *std::max_element(INDEX_WIDTH.begin(), INDEX_WIDTH.end());
     static constexpr size_t MAX_TAG_WIDTH = *std::max_element(TAG_WIDTH.begin(), TAG_WIDTH.end());
 
-    using Ctr = Counter<CTR_WIDTH>;
-    using Index = uint16_t;
-    using Tag = uint16_t;
-    using Useful = Counter<USEFUL_WIDTH, RSHIFT_TO_DECRE_USE>;
+    using TageEntry = TaggedEntry<CTR_WIDTH, USEFUL_WIDTH, MAX_TAG_WIDTH, RSHIFT_TO_DECRE_USE>;
     using UseAlt = Counter<USEALT_WIDTH>;
 
-    struct TageEntry
-    {
-      public:
-        Ctr pred;
-        Tag tag;
-        Useful useful;
+    using HistoryState = TaggedHistory<COMPONENT_NUM, HIST_LEN, PATH_HIST_LEN, INDEX_WIDTH, TAG_WIDTH, COMPLICATED_HASH>;
+    using Tables = TaggedTables<TageEntry, COMPONENT_NUM, INDEX_WIDTH>;
+    using LookupContext = typename Tables::LookupContext;
+    using CompEntey = typename Tables::CompEntry;
+    static constexpr auto NULL_ENTRY = Tables::NULL_ENTRY;
 
-      public:
-        TageEntry()
-        {
-            pred = Ctr(exp2(CTR_WIDTH - 1)); // weakly taken
-        }
+    enum Stage : size_t
+    {
+        HASH,
+        MATCH,
+        ALLOC,
+        HISTORY,
+        CLEAR_USEFUL,
+        STAGE_NUM
     };
-
-    using CompEntey = std::pair<int, TageEntry *>;
-    static constexpr auto NULL_ENTRY = CompEntey(-1, nullptr);
+    static constexpr std::array<std::string_view, STAGE_NUM> STAGE_NAME = {"hash", "match", "alloc", "history",
+                                                                          "clear useful"};
+    using Probes = StageProbes<Tage, STAGE_NUM>;
+    using Probe = ScopedProbe<Probes, PROBE_STAGES>;
 
   private:
-    // use bool array instead std::bitset delivered a 4-fold increase in
-    // performance
-    bool global_history[MAX_HIST_LEN];
-    bool path_history[PATH_HIST_LEN]; // the last bits of the last branch PCs
+    HistoryState history;
+    // at the branch being looked ahead at, only allocated once prefetching is switched on
+    std::unique_ptr<HistoryState> projected;
 
     Bimodal<2, BASE_WIDTH> base;
-    TageEntry predict_table[COMPONENT_NUM][exp2(MAX_INDEX_WIDTH)];
+    Tables tables;
     UseAlt use_alt_on_na;
     Counter<RESET_STRATEGY.second> success_alloc;
     Counter<RESET_STRATEGY.second> branch;
+    Xorshift rng;
 
     // last prediction
     bool used_alt;
@@ -115,124 +121,16 @@ class Tage : public IDirectionPredictor
     bool prediction;
     CompEntey provider;
     CompEntey alter;
+    LookupContext lookup;
 
   private:
-    uint64_t foldGlobalHistory(const size_t original_size, const size_t folded_size)
-    {
-        uint64_t folded_hist = 0, temp_hist = 0;
-        for (unsigned i = 0; i < original_size; i++)
-        {
-            if (i % folded_size == 0)
-            {
-                folded_hist ^= temp_hist;
-                temp_hist = 0;
-            }
-            temp_hist = (temp_hist << 1) | global_history[i];
-        }
-        folded_hist ^= temp_hist;
-        return folded_hist;
-    }
-
-    template <bool COMPLICATED>
-    uint64_t foldPathHistory(const int component)
-        requires(COMPLICATED)
-    {
-        const int original_size = std::min(HIST_LEN(component), PATH_HIST_LEN);
-        const int folded_size = INDEX_WIDTH[component];
-        const uint64_t bitmask_folded = bitmask(folded_size);
-        uint64_t path = 0;
-        for (auto i = original_size - 1; i >= 0; i--)
-        {
-            path = (path << 1) | path_history[i];
-        }
-        path = path & bitmask(original_size);
-
-        auto F = [component, bitmask_folded](uint64_t x) {
-            return ((x << component) & bitmask_folded) + (x >> std::abs(int(INDEX_WIDTH[component] - component)));
-        };
-        return F((path & bitmask_folded) ^ F((path >> INDEX_WIDTH[component]) & bitmask_folded));
-    }
-
-    template <bool COMPLICATED>
-    uint64_t foldPathHistory(const int component)
-        requires(!COMPLICATED)
-    {
-        const int original_size = std::min(HIST_LEN(component), PATH_HIST_LEN);
-        const auto folded_size = INDEX_WIDTH[component];
-        uint64_t folded_hist = 0, path = 0;
-        for (auto i = 0; i < original_size; i++)
-        {
-            if (i % folded_size == 0)
-            {
-                folded_hist ^= path;
-                path = 0;
-            }
-            path = (path << 1) | path_history[i];
-        }
-        folded_hist ^= path;
-        return folded_hist;
-    }
-
-    uint64_t foldPathHistory(const int component)
-    {
-        return foldPathHistory<COMPLICATED_HASH>(component);
-    }
-
-    Tag getTag(uint64_t ip, const int component)
-    {
-        const uint64_t ghist_hash = foldGlobalHistory(HIST_LEN(component), TAG_WIDTH[component])
-                                    ^ foldGlobalHistory(HIST_LEN(component), TAG_WIDTH[component] - 1);
-        return (ghist_hash ^ ip) & bitmask(TAG_WIDTH[component]);
-    }
-
-    Index getIndex(uint64_t ip, const int component)
-    {
-        const uint64_t ghist_hash = foldGlobalHistory(HIST_LEN(component), TAG_WIDTH[component]);
-        const uint64_t phist_hash = foldPathHistory(component);
-        return (ghist_hash ^ phist_hash ^ ip) & bitmask(INDEX_WIDTH[component]);
-    }
-
-    CompEntey matchComp(uint64_t ip, const int below = COMPONENT_NUM)
+    // the provider is the longest matching component and the altpred the next longer one below it
+    void matchComp()
     {
-        for (auto i = below - 1; i >= 0; i--)
-        {
-            const auto index = getIndex(ip, i);
-            const auto tag = getTag(ip, i);
-            if (predict_table[i][index].tag == tag)
-                return CompEntey(i, &predict_table[i][index]);
-        }
-        return NULL_ENTRY; // base predictor
-    }
-
-    CompEntey allocEntry(uint64_t ip, const int start)
-    {
-        for (auto i = start; i < COMPONENT_NUM; i++)
-        {
-            TageEntry *const entry = &predict_table[i][getIndex(ip, i)];
-            const auto alloc = entry->useful.none() && (USEFUL_WIDTH > 1 || !entry->pred.isStrong());
-            // when u is single-bit, only entries with u = 0 and pred is not strong
-            // can be replaced
-            if (alloc)
-            {
-                entry->pred = Ctr(exp2(CTR_WIDTH - 1));
-                entry->useful = Useful();
-                entry->tag = getTag(ip, i);
-                return CompEntey(i, entry);
-            }
-            success_alloc.update(alloc);
-        }
-        return NULL_ENTRY;
-    }
-
-    void updateHistory(uint64_t ip, bool taken)
-    {
-        for (auto i = MAX_HIST_LEN - 1; i > 0; i--)
-            global_history[i] = global_history[i - 1];
-        global_history[0] = taken;
-
-        for (auto i = PATH_HIST_LEN - 1; i > 0; i--)
-            path_history[i] = path_history[i - 1];
-        path_history[0] = ip & 1;
+        const auto match = tables.match(lookup);
+        provider = tables.longestMatch(lookup, match);
+        alter = USE_BASE_AS_ALT || !provider.second ? NULL_ENTRY
+                                                    : tables.longestMatch(lookup, match & bitmask(provider.first));
     }
 
     template <bool STRATEGY>
@@ -242,9 +140,7 @@ class Tage : public IDirectionPredictor
         if (success_alloc.none())
         {
             success_alloc.set();
-            for (auto &comp : predict_table)
-                for (auto &entry : comp)
-                    entry.useful--;
+            tables.age();
         }
     }
 
@@ -255,9 +151,7 @@ class Tage : public IDirectionPredictor
         if (branch.all())
         {
             branch.reset();
-            for (auto &comp : predict_table)
-                for (auto &entry : comp)
-                    entry.useful--;
+            tables.age();
         }
     }
 
@@ -267,17 +161,66 @@ class Tage : public IDirectionPredictor
     }
 
   public:
-    Tage()
+    static constexpr StorageReport storage()
+    {
+        size_t bits = exp2(BASE_WIDTH) * 2 + USEALT_WIDTH + RESET_STRATEGY.second + MAX_HIST_LEN + PATH_HIST_LEN;
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+            bits += exp2(INDEX_WIDTH[i]) * (CTR_WIDTH + TAG_WIDTH[i] + USEFUL_WIDTH);
+        // the tables of the components and of the base predictor live in the arena
+        const size_t table_bytes = sizeof(TageEntry) * Tables::TABLE_SIZE;
+        return {bits, table_bytes, sizeof(Tage) + table_bytes + sizeof(Counter<2>) * exp2(BASE_WIDTH)};
+    }
+
+    explicit Tage(uint64_t seed = 1) : rng(seed)
     {
         use_alt_on_na = UseAlt(exp2(USEALT_WIDTH - 1));
     }
 
     const std::string &getName() override
     {
-        static const std::string name = fmt::format("TAGE<>");
+        // every parameter shaping the state, so that restore() rejects a snapshot of another config
+        static const std::string name = [] {
+            std::string widths;
+            for (size_t i = 0; i < COMPONENT_NUM; i++)
+                widths += fmt::format("{}{}:{}", i ? " " : "", INDEX_WIDTH[i], TAG_WIDTH[i]);
+            std::string flags;
+            for (const auto &[set, flag] : {std::pair{RSHIFT_TO_DECRE_USE, "RSHIFT"}, {USE_BASE_AS_ALT, "BASE_AS_ALT"},
+                                            {ALLOC_ATLEAST_ONE, "ATLEAST_ONE"},
+                                            {UPDATE_ALT_WHEN_USEFUL_NONE, "UPDATE_ALT"},
+                                            {COMPLICATED_HASH, "COMPLICATED_HASH"}})
+                if (set)
+                    flags += fmt::format(" {}", flag);
+            return fmt::format("TAGE<{}, {}, {}, {}, {}, {}, {}-{}, [{}], {} {},{} {} {}, {}>", COMPONENT_NUM, CTR_WIDTH,
+                               USEFUL_WIDTH, USEALT_WIDTH, BASE_WIDTH, PATH_HIST_LEN, MIN_HIST_LEN, MAX_HIST_LEN,
+                               widths, ALLOC_NUM, allocCondName(ALLOC_COND), flags,
+                               RESET_STRATEGY.first ? "SUCCESS_RESET" : "BRANCH_RESET", RESET_STRATEGY.second,
+                               PC_SHIFT_AMT);
+        }();
         return name;
     }
 
+    std::string report() override
+    {
+        constexpr auto budget = storage();
+        return IDirectionPredictor::report()
+               + fmt::format("\t storage = {} Kbits modelled, {} KB tables, {} KB resident\n",
+                             budget.modelled_bits / 1024.0, budget.table_bytes / 1024.0, budget.total_bytes / 1024.0);
+    }
+
+    // per-thread stage timings of every predictor of this type merged, empty unless PROBE_STAGES
+    std::string probes() override
+    {
+        if constexpr (PROBE_STAGES)
+            return Probes::report(STAGE_NAME);
+        return "";
+    }
+
+    // the last prediction came from a tagged component with a saturated counter
+    bool highConfidence() const
+    {
+        return !used_alt && provider.second && provider.second->pred().isStrong();
+    }
+
     bool predict(uint64_t ip) override
     {
         ip >>= PC_SHIFT_AMT;
@@ -285,22 +228,28 @@ class Tage : public IDirectionPredictor
         used_base = false;
         branch++;
 
-        provider = matchComp(ip);
-        alter = USE_BASE_AS_ALT ? NULL_ENTRY : matchComp(ip, provider.first);
+        {
+            Probe probe(HASH);
+            tables.hash(history, ip, lookup);
+        }
+        {
+            Probe probe(MATCH);
+            matchComp();
+        }
         auto provider_entry = provider.second;
         auto alter_entry = alter.second;
         if (provider_entry)
         {
-            if (!use_alt_on_na.get() || provider_entry->pred.isStrong()) // use provider
+            if (!use_alt_on_na.get() || provider_entry->pred().isStrong()) // use provider
             {
-                prediction = provider_entry->pred.get();
+                prediction = provider_entry->pred().get();
             }
             else
             {
                 used_alt = true;
                 if (alter_entry) // use altpred
                 {
-                    prediction = alter_entry->pred.get();
+                    prediction = alter_entry->pred().get();
                 }
                 else
                 {
@@ -324,7 +273,7 @@ class Tage : public IDirectionPredictor
         auto alter_entry = alter.second;
 
         auto mispredict = [taken](TageEntry *entry) -> bool {
-            return !entry || entry->pred.get() != taken;
+            return !entry || entry->pred().get() != taken;
         };
         bool need_alloc;
         if (ALLOC_COND == AllocCond::ALL_MISPRED)
@@ -340,27 +289,27 @@ class Tage : public IDirectionPredictor
         if (provider_entry)
         {
             assert(!used_alt || (bool(alter_entry) ^ used_base));
-            const auto provider_pred = provider_entry->pred.get();
-            const auto altpred = alter_entry ? alter_entry->pred.get() : prediction;
+            const auto provider_pred = provider_entry->pred().get();
+            const auto altpred = alter_entry ? alter_entry->pred().get() : prediction;
             const auto provider_correct = provider_pred == taken;
-            const auto update_alt = used_alt || (UPDATE_ALT_WHEN_USEFUL_NONE && provider_entry->useful.none());
+            const auto update_alt = used_alt || (UPDATE_ALT_WHEN_USEFUL_NONE && provider_entry->useful().none());
             const auto pred_distinct = provider_pred != altpred;
 
             if (pred_distinct)
             {
                 use_alt_on_na.update(!provider_correct);
-                provider_entry->useful.update(provider_correct,
-                                              !used_alt); // only decrese provider's useful when it is used
+                provider_entry->updateUseful(provider_correct,
+                                             !used_alt); // only decrese provider's useful when it is used
             }
 
             if (update_alt)
             {
                 if (alter_entry)
-                    alter_entry->pred.update(taken);
+                    alter_entry->updatePred(taken);
                 else
                     base.update(ip, taken);
             }
-            provider_entry->pred.update(taken);
+            provider_entry->updatePred(taken);
         }
         else
             base.update(ip, taken);
@@ -368,27 +317,100 @@ class Tage : public IDirectionPredictor
         // allocate new entry
         if (need_alloc)
         {
-            const auto random = rand();
+            const auto random = int(rng.next());
             const auto start = provider.first + 1 + (random & 1) + (random & 2);
             assert(start >= 0);
 
-            const auto first_alloc = allocEntry(ip, start);
-            auto last_alloc = first_alloc;
-            for (auto i = 1; i < ALLOC_NUM; i++)
-                if (last_alloc.second)
-                    last_alloc = allocEntry(ip, last_alloc.first);
+            Probe probe(ALLOC);
+            tables.template allocate<ALLOC_NUM, ALLOC_ATLEAST_ONE>(
+                lookup, start, [](TageEntry &entry, uint16_t tag, size_t) { entry.alloc(tag); },
+                [this] { success_alloc.update(false); });
+        }
 
-            // allocate at least one entry
-            if (ALLOC_ATLEAST_ONE && !first_alloc.second)
-            {
-                const auto alloc_comp = std::min(start + 1, int(COMPONENT_NUM - 1));
-                predict_table[alloc_comp][getIndex(ip, alloc_comp)].useful.reset();
-                allocEntry(ip, start);
-            }
+        {
+            Probe probe(CLEAR_USEFUL);
+            clearUseful();
         }
+        {
+            Probe probe(HISTORY);
+            history.update(ip, taken);
+        }
+    }
+
+    // functional warming: only the provider (or the base) learns the outcome, and a misprediction by it
+    // allocates from the next component up; use_alt_on_na, the useful counters and the allocation
+    // randomness are left alone
+    void warm(uint64_t ip, bool taken)
+    {
+        ip >>= PC_SHIFT_AMT;
+        branch++;
+        tables.hash(history, ip, lookup);
+        provider = tables.longestMatch(lookup, tables.match(lookup));
+
+        bool mispredicted;
+        if (provider.second)
+        {
+            mispredicted = provider.second->pred().get() != taken;
+            provider.second->updatePred(taken);
+        }
+        else
+        {
+            mispredicted = base.predict(ip) != taken;
+            base.update(ip, taken);
+        }
+        if (mispredicted)
+            tables.template allocate<ALLOC_NUM, ALLOC_ATLEAST_ONE>(
+                lookup, provider.first + 1, [](TageEntry &entry, uint16_t tag, size_t) { entry.alloc(tag); },
+                [this] { success_alloc.update(false); });
 
         clearUseful();
-        updateHistory(ip, taken);
+        history.update(ip, taken);
+    }
+
+    void lookaheadBegin()
+    {
+        if (projected)
+            *projected = history;
+        else
+            projected = std::make_unique<HistoryState>(history);
+    }
+
+    void lookahead(const BranchRecord &record)
+    {
+        const auto ip = record.ip >> PC_SHIFT_AMT;
+        tables.prefetch(*projected, ip);
+        projected->update(ip, record.taken);
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Tage>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<Tage, false>(records);
+    }
+
+    // the raw histories are pushed branch by branch and folded once at the end of the batch
+    void skipBatch(std::span<const BranchRecord> records) override
+    {
+        for (const auto &record : records)
+            if (record.kind == BranchKind::CONDITIONAL)
+                history.push(record.ip >> PC_SHIFT_AMT, record.taken);
+        history.refold();
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        // provider, alter and lookup only live between predict and update, projected within a batch
+        s.raw(history);
+        base.snapshot(s);
+        tables.snapshot(s);
+        s.raw(use_alt_on_na);
+        s.raw(success_alloc);
+        s.raw(branch);
+        s.raw(rng);
     }
 };
 
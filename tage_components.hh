@@ -0,0 +1,390 @@
+#ifndef __TAGE_COMPONENTS_HH__
+#define __TAGE_COMPONENTS_HH__
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <ratio>
+#include <utility>
+
+#include "arena.hh"
+#include "bp.hh"
+#include "history.hh"
+#include "snapshot.hh"
+#include "tag_match.hh"
+#include "util.hh"
+
+// building blocks shared by the TAGE family of predictors: geometric history lengths, folded
+// histories with their hashes, packed tagged entries, and the tagged components with lazy aging,
+// tag matching and allocation
+
+template <typename T>
+concept ratioSpec = std::same_as<T, std::ratio<T::num, T::den>>;
+
+struct StorageReport
+{
+    size_t modelled_bits; // storage budget of the modelled hardware
+    size_t table_bytes;   // resident size of the tagged components
+    size_t total_bytes;   // resident size of the whole predictor
+};
+
+// history lengths growing geometrically from MIN_HIST_LEN by HIST_ALPHA
+// we use the formula according to the original paper
+// since manually optimized set of history lengths leads to a limited benefits
+// (<0.5%)
+template <size_t COMPONENT_NUM, size_t MIN_HIST_LEN, ratioSpec HIST_ALPHA>
+constexpr std::array<size_t, COMPONENT_NUM> geometricHistLen()
+{
+    std::array<size_t, COMPONENT_NUM> len = {};
+    for (size_t n = 0; n < COMPONENT_NUM; n++)
+    {
+        auto power = 1.0;
+        for (size_t i = 0; i <= n; i++)
+            power *= double(HIST_ALPHA::num) / HIST_ALPHA::den;
+        len[n] = size_t(MIN_HIST_LEN * power + 0.5);
+    }
+    return len;
+}
+
+// counters are packed into a single word and unpacked on access
+// the tag is kept in the upper bits, so the tags of several entries are extracted with one shift
+template <size_t CTR_WIDTH, size_t USEFUL_WIDTH, size_t TAG_WIDTH, bool RSHIFT_TO_DECRE_USE>
+    requires(CTR_WIDTH + USEFUL_WIDTH + TAG_WIDTH <= 32)
+struct TaggedEntry
+{
+    using Ctr = Counter<CTR_WIDTH>;
+    using Useful = Counter<USEFUL_WIDTH, RSHIFT_TO_DECRE_USE>;
+    using Tag = uint16_t;
+    using EntryField = uint32_t;
+
+    static constexpr size_t USEFUL_SHIFT = CTR_WIDTH;
+    static constexpr size_t TAG_SHIFT = CTR_WIDTH + USEFUL_WIDTH;
+    static constexpr size_t MAX_TAG_WIDTH = TAG_WIDTH;
+    static constexpr EntryField WEAK_CTR = exp2(CTR_WIDTH - 1);
+
+  private:
+    EntryField bits = WEAK_CTR; // weakly taken
+
+    EntryField field(size_t shift, size_t width) const
+    {
+        return (bits >> shift) & bitmask(width);
+    }
+
+    void setField(size_t shift, size_t width, uint64_t value)
+    {
+        bits = (bits & ~bitmask(shift + width, shift)) | (value << shift);
+    }
+
+  public:
+    Tag tag() const
+    {
+        return field(TAG_SHIFT, TAG_WIDTH);
+    }
+
+    Ctr pred() const
+    {
+        return Ctr(field(0, CTR_WIDTH));
+    }
+
+    Useful useful() const
+    {
+        return Useful(field(USEFUL_SHIFT, USEFUL_WIDTH));
+    }
+
+    void updatePred(bool taken)
+    {
+        auto ctr = pred();
+        ctr.update(taken);
+        setField(0, CTR_WIDTH, ctr.to_ulong());
+    }
+
+    void updateUseful(bool cond, bool decreCond = true)
+    {
+        auto ctr = useful();
+        ctr.update(cond, decreCond);
+        setField(USEFUL_SHIFT, USEFUL_WIDTH, ctr.to_ulong());
+    }
+
+    void decreUseful()
+    {
+        auto ctr = useful();
+        ctr--;
+        setField(USEFUL_SHIFT, USEFUL_WIDTH, ctr.to_ulong());
+    }
+
+    void resetUseful()
+    {
+        setField(USEFUL_SHIFT, USEFUL_WIDTH, 0);
+    }
+
+    // when u is single-bit, only entries with u = 0 and pred is not strong can be replaced
+    bool replaceable() const
+    {
+        return useful().none() && (USEFUL_WIDTH > 1 || !pred().isStrong());
+    }
+
+    void alloc(Tag new_tag, EntryField ctr = WEAK_CTR)
+    {
+        bits = (EntryField(new_tag) << TAG_SHIFT) | ctr;
+    }
+};
+
+// global and path histories of the tagged components with their incrementally folded copies
+// the histories only depend on the outcomes and PCs, never on predictions, so a copy can be run ahead
+// of the predictor to project them exactly from the trace
+template <size_t COMPONENT_NUM,
+          std::array<size_t, COMPONENT_NUM> HIST_LEN,
+          size_t PATH_HIST_LEN,
+          std::array<size_t, COMPONENT_NUM> INDEX_WIDTH,
+          std::array<size_t, COMPONENT_NUM> TAG_WIDTH,
+          bool COMPLICATED_HASH // fold the path history with the hash of the original paper
+          >
+struct TaggedHistory
+{
+    static constexpr size_t MAX_HIST_LEN = HIST_LEN[COMPONENT_NUM - 1];
+
+    History<MAX_HIST_LEN> global_history;
+    History<PATH_HIST_LEN> path_history; // the last bits of the last branch PCs
+
+    // folded histories of each component, updated along with the histories
+    // note that the index is hashed with the global history folded to the tag width
+    FoldedHistory global_fold[COMPONENT_NUM];
+    FoldedHistory global_fold_short[COMPONENT_NUM]; // folded to the tag width - 1
+    FoldedHistory path_fold[COMPONENT_NUM];
+
+    TaggedHistory()
+    {
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+        {
+            global_fold[i] = FoldedHistory(HIST_LEN[i], TAG_WIDTH[i]);
+            global_fold_short[i] = FoldedHistory(HIST_LEN[i], TAG_WIDTH[i] - 1);
+            path_fold[i] = FoldedHistory(std::min(HIST_LEN[i], PATH_HIST_LEN), INDEX_WIDTH[i]);
+        }
+    }
+
+    void update(uint64_t ip, bool taken)
+    {
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+        {
+            global_fold[i].update(taken, global_history);
+            global_fold_short[i].update(taken, global_history);
+            path_fold[i].update(ip & 1, path_history);
+        }
+
+        global_history.push(taken);
+        path_history.push(ip & 1);
+    }
+
+    // push the outcome without updating the folded histories, which are stale until refold()
+    void push(uint64_t ip, bool taken)
+    {
+        global_history.push(taken);
+        path_history.push(ip & 1);
+    }
+
+    // rebuild the folded histories from the raw ones, by replaying them from the oldest bit into a
+    // fresh state: a fold only depends on the bits still within its length
+    void refold()
+    {
+        TaggedHistory replay;
+        for (size_t i = std::max(MAX_HIST_LEN, PATH_HIST_LEN); i-- > 0;)
+            replay.update(i < PATH_HIST_LEN && path_history[i], i < MAX_HIST_LEN && global_history[i]);
+        *this = replay;
+    }
+
+    template <bool COMPLICATED>
+    uint64_t foldPathHistory(const int component) const
+        requires(COMPLICATED)
+    {
+        const int original_size = std::min(HIST_LEN[component], PATH_HIST_LEN);
+        const int folded_size = INDEX_WIDTH[component];
+        const uint64_t bitmask_folded = bitmask(folded_size);
+        const uint64_t path = path_history.recent(original_size);
+
+        auto F = [component, bitmask_folded](uint64_t x) {
+            return ((x << component) & bitmask_folded) + (x >> std::abs(int(INDEX_WIDTH[component] - component)));
+        };
+        return F((path & bitmask_folded) ^ F((path >> INDEX_WIDTH[component]) & bitmask_folded));
+    }
+
+    template <bool COMPLICATED>
+    uint64_t foldPathHistory(const int component) const
+        requires(!COMPLICATED)
+    {
+        return path_fold[component].get();
+    }
+
+    uint64_t foldPathHistory(const int component) const
+    {
+        return foldPathHistory<COMPLICATED_HASH>(component);
+    }
+
+    uint16_t getTag(uint64_t ip, const int component) const
+    {
+        const uint64_t ghist_hash = global_fold[component].get() ^ global_fold_short[component].get();
+        return (ghist_hash ^ ip) & bitmask(TAG_WIDTH[component]);
+    }
+
+    uint16_t getIndex(uint64_t ip, const int component) const
+    {
+        const uint64_t ghist_hash = global_fold[component].get();
+        const uint64_t phist_hash = foldPathHistory(component);
+        return (ghist_hash ^ phist_hash ^ ip) & bitmask(INDEX_WIDTH[component]);
+    }
+};
+
+// the tagged components, stored back to back in the arena, each sized to its own index width
+// useful counters are aged lazily: a reset only bumps aging_epoch, and a cache-line sized bank
+// of entries catches up on the resets it missed the next time one of its entries is accessed
+template <typename Entry, size_t COMPONENT_NUM, std::array<size_t, COMPONENT_NUM> INDEX_WIDTH>
+class TaggedTables
+{
+    static_assert(sizeof(Entry) == sizeof(uint32_t)); // matched as words
+
+  public:
+    static constexpr std::array<size_t, COMPONENT_NUM + 1> TABLE_OFFSET = [] {
+        std::array<size_t, COMPONENT_NUM + 1> offset = {};
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+            offset[i + 1] = offset[i] + exp2(INDEX_WIDTH[i]);
+        return offset;
+    }();
+    static constexpr size_t TABLE_SIZE = TABLE_OFFSET[COMPONENT_NUM];
+
+    using CompEntry = std::pair<int, Entry *>;
+    static constexpr auto NULL_ENTRY = CompEntry(-1, nullptr);
+
+  private:
+    static constexpr size_t AGING_BANK = std::max<size_t>(1, 64 / sizeof(Entry));
+    static constexpr size_t AGING_BANK_NUM = (TABLE_SIZE + AGING_BANK - 1) / AGING_BANK;
+
+    // the tags of all components are compared at once, lanes past the last component never match
+    static constexpr size_t MATCH_LANES = (COMPONENT_NUM + 15) / 16 * 16;
+    using Matcher = TagMatcher<MATCH_LANES, Entry::TAG_SHIFT, bitmask(Entry::MAX_TAG_WIDTH)>;
+
+  public:
+    // hashes of the current branch, computed once by predict and reused by update
+    struct LookupContext
+    {
+        uint32_t pos[MATCH_LANES] = {}; // of the probed entries in the tables
+        uint32_t tag[MATCH_LANES];
+
+        LookupContext()
+        {
+            std::fill(std::begin(tag), std::end(tag), Matcher::PAD_TAG);
+        }
+    };
+
+  private:
+    ArenaArray<Entry, TABLE_SIZE> table;
+    uint64_t aging_epoch = 0;
+    uint64_t bank_epoch[AGING_BANK_NUM] = {};
+
+    void ageBank(size_t bank)
+    {
+        const auto missed = aging_epoch - bank_epoch[bank];
+        if (!missed)
+            return;
+        bank_epoch[bank] = aging_epoch;
+        // useful counters are all 0 after max decrements
+        const auto times = std::min<uint64_t>(missed, Entry::Useful::max);
+        const auto end = std::min((bank + 1) * AGING_BANK, TABLE_SIZE);
+        for (auto i = bank * AGING_BANK; i < end; i++)
+            for (uint64_t t = 0; t < times; t++)
+                table[i].decreUseful();
+    }
+
+  public:
+    Entry *getEntry(size_t pos)
+    {
+        ageBank(pos / AGING_BANK);
+        return &table[pos];
+    }
+
+    // decrements every useful counter
+    void age()
+    {
+        aging_epoch++;
+    }
+
+    template <typename HistoryT>
+    void hash(const HistoryT &history, uint64_t ip, LookupContext &lookup) const
+    {
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+        {
+            lookup.pos[i] = TABLE_OFFSET[i] + history.getIndex(ip, i);
+            lookup.tag[i] = history.getTag(ip, i);
+        }
+    }
+
+    template <typename HistoryT>
+    void prefetch(const HistoryT &history, uint64_t ip)
+    {
+        for (size_t i = 0; i < COMPONENT_NUM; i++)
+            __builtin_prefetch(&table[TABLE_OFFSET[i] + history.getIndex(ip, i)], 1);
+    }
+
+    // bit i is set if component i matches
+    uint32_t match(const LookupContext &lookup)
+    {
+        return Matcher::match(reinterpret_cast<const uint32_t *>(table.data()), lookup.pos, lookup.tag);
+    }
+
+    // the longest matching component of a match mask
+    CompEntry longestMatch(const LookupContext &lookup, uint32_t match)
+    {
+        if (!match)
+            return NULL_ENTRY;
+        const int component = 31 - std::countl_zero(match);
+        return CompEntry(component, getEntry(lookup.pos[component]));
+    }
+
+    // replaces the first replaceable entry from component start on, init(entry, tag, pos) fills it with the
+    // tag of its component and fail is called for every entry that could not be replaced
+    template <typename Init, typename Fail>
+    CompEntry allocEntry(const LookupContext &lookup, const int start, Init &&init, Fail &&fail)
+    {
+        for (auto i = start; i < int(COMPONENT_NUM); i++)
+        {
+            Entry *const entry = getEntry(lookup.pos[i]);
+            if (entry->replaceable())
+            {
+                init(*entry, lookup.tag[i], lookup.pos[i]);
+                return CompEntry(i, entry);
+            }
+            fail();
+        }
+        return NULL_ENTRY;
+    }
+
+    // allocates up to ALLOC_NUM entries in the components from start on, and when none is free and
+    // ALLOC_ATLEAST_ONE, forces one into the component after start
+    template <size_t ALLOC_NUM, bool ALLOC_ATLEAST_ONE, typename Init, typename Fail>
+    void allocate(const LookupContext &lookup, const int start, Init &&init, Fail &&fail)
+    {
+        const auto first_alloc = allocEntry(lookup, start, init, fail);
+        auto last_alloc = first_alloc;
+        for (size_t i = 1; i < ALLOC_NUM; i++)
+            if (last_alloc.second)
+                last_alloc = allocEntry(lookup, last_alloc.first, init, fail);
+
+        if (ALLOC_ATLEAST_ONE && !first_alloc.second)
+        {
+            const auto alloc_comp = std::min(start + 1, int(COMPONENT_NUM - 1));
+            getEntry(lookup.pos[alloc_comp])->resetUseful();
+            allocEntry(lookup, start, init, fail);
+        }
+    }
+
+    void snapshot(Snapshot &s)
+    {
+        s.raw(table.array());
+        s.raw(aging_epoch);
+        s.raw(bank_epoch);
+    }
+};
+
+#endif
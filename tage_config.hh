@@ -5,6 +5,7 @@
 #include <ratio>
 
 #include "tage.hh"
+#include "tage_scl.hh"
 
 template <size_t n>
 using WidthArray = std::array<size_t, n>;
@@ -37,9 +38,17 @@ using HugeWith1UCondLTage = Tage<12, 3, 1, 4, 14, 32, 4, std::ratio<8, 5>, Huge_
 using HugeWithRightShiftTage = Tage<12, 3, 2, 4, 14, 32, 4, std::ratio<8, 5>, Huge_index_width, Huge_tag_width, true, false, 1,
                                     AllocCond::FINAL_MISPRED, false, true, false, success_reset_strategy>;
 
+// HugeTage with its stages timed, see Tage::probes
+using HugeTageProbed = Tage<12, 3, 2, 4, 14, 32, 4, std::ratio<8, 5>, Huge_index_width, Huge_tag_width, false, false, 1,
+                            AllocCond::FINAL_MISPRED, false, true, false, success_reset_strategy, 2, true>;
+
 constexpr WidthArray<10> L32_index_width = {8, 8, 8, 8, 7, 8, 7, 6, 6, 6};
 constexpr WidthArray<10> L32_tag_width = {7, 7, 7, 8, 9, 10, 10, 11, 13, 13};
 using L32Tage = Tage<10, 3, 2, 5, 12, 27, 4, std::ratio<19, 10>, L32_index_width, L32_tag_width, true, false, 1,
                      AllocCond::FINAL_MISPRED, false, true, false, success_reset_strategy>;
 
+using HugeTageL = TageScl<HugeTage, true, false>;
+using HugeTageSC = TageScl<HugeTage, false, true>;
+using HugeTageSCL = TageScl<HugeTage, true, true>;
+
 #endif
@@ -0,0 +1,377 @@
+#ifndef __TAGE_SCL_HH__
+#define __TAGE_SCL_HH__
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fmt/core.h>
+#include <type_traits>
+#include <utility>
+
+#include "arena.hh"
+#include "bp.hh"
+#include "history.hh"
+#include "perceptron.hh"
+#include "tage.hh"
+#include "util.hh"
+
+// predicts the exit of loops with a constant trip count, which TAGE only learns with a long enough history
+// entries count the iterations of the loop body direction and predict the other direction once the
+// trip count has been seen CONF_MAX times in a row
+template <size_t INDEX_WIDTH, size_t TAG_WIDTH, size_t WAYS = 4, size_t ITER_WIDTH = 10>
+    requires(TAG_WIDTH <= 16 && ITER_WIDTH <= 16)
+class LoopPredictor
+{
+  private:
+    static constexpr uint8_t CONF_MAX = 3;
+    static constexpr uint8_t AGE_MAX = 7;
+    static constexpr uint16_t ITER_MAX = exp2(ITER_WIDTH) - 1;
+    static constexpr uint16_t MIN_TRIP = 3; // shorter loops are left to TAGE
+
+    struct LoopEntry
+    {
+        uint16_t tag;
+        uint16_t past_iter; // trip count, 0 until the first exit
+        uint16_t current_iter;
+        uint8_t confidence;
+        uint8_t age; // only replaced once aged to 0
+        bool dir;    // of the loop body
+        bool valid;
+    };
+
+    ArenaArray<LoopEntry, exp2(INDEX_WIDTH) * WAYS> loop_table; // sets of WAYS entries
+    Counter<7> use_loop = Counter<7>(exp2(size_t(6))); // whether the loop predictor beats TAGE when they disagree
+
+    // last lookup
+    LoopEntry *set;
+    LoopEntry *entry;
+    uint16_t tag;
+    bool hit;
+    bool pred;
+
+  public:
+    void lookup(uint64_t ip)
+    {
+        set = &loop_table[(ip & bitmask(INDEX_WIDTH)) * WAYS];
+        tag = fold<64 - INDEX_WIDTH, TAG_WIDTH>(ip >> INDEX_WIDTH);
+        entry = std::find_if(set, set + WAYS, [this](const LoopEntry &way) { return way.valid && way.tag == tag; });
+        hit = entry != set + WAYS;
+        pred = hit && (entry->current_iter + 1 == entry->past_iter ? !entry->dir : entry->dir);
+    }
+
+    // the loop prediction overrides TAGE
+    bool valid() const
+    {
+        return hit && entry->confidence == CONF_MAX && use_loop.get();
+    }
+
+    bool prediction() const
+    {
+        return pred;
+    }
+
+    void update(bool taken, bool tage_pred)
+    {
+        const bool confident = hit && entry->confidence == CONF_MAX;
+        if (confident && pred != tage_pred)
+            use_loop.update(pred == taken);
+        if (!hit)
+        {
+            // a TAGE misprediction may be the exit of a loop, allocated with the other direction as the body
+            // in a way aged to 0, otherwise the least confident way ages towards replacement, unless it is
+            // confident too: mispredictions of non-loop branches must not wear out the loops being tracked
+            if (tage_pred != taken)
+            {
+                auto *victim = std::find_if(set, set + WAYS, [](const LoopEntry &way) { return !way.age; });
+                if (victim != set + WAYS)
+                    *victim = {tag, 0, 0, 0, AGE_MAX, !taken, true};
+                else
+                {
+                    auto *weakest = std::min_element(set, set + WAYS, [](const LoopEntry &a, const LoopEntry &b) {
+                        return std::pair(a.confidence, a.age) < std::pair(b.confidence, b.age);
+                    });
+                    if (weakest->confidence < CONF_MAX)
+                        weakest->age--;
+                }
+            }
+            return;
+        }
+
+        if (confident && pred != taken)
+        {
+            *entry = {}; // the trip count changed
+            return;
+        }
+        if (confident && tage_pred != taken)
+            entry->age = std::min<uint8_t>(entry->age + 1, AGE_MAX);
+
+        if (taken == entry->dir)
+        {
+            if (entry->current_iter++ == ITER_MAX)
+                *entry = {}; // too long to be tracked
+            return;
+        }
+        // exit
+        const auto trip = entry->current_iter + 1;
+        if (trip < MIN_TRIP)
+        {
+            // most likely allocated on a misprediction inside the loop, the other direction is the body, or
+            // not a loop at all, so it is the first to be replaced
+            entry->dir = !entry->dir;
+            entry->past_iter = 0;
+            entry->confidence = 0;
+            entry->age = 0;
+        }
+        else if (trip == entry->past_iter)
+        {
+            // a repeated trip count is what the entry is for, it is kept longer
+            entry->confidence = std::min<uint8_t>(entry->confidence + 1, CONF_MAX);
+            entry->age = std::min<uint8_t>(entry->age + 1, AGE_MAX);
+        }
+        else
+        {
+            entry->past_iter = trip;
+            entry->confidence = 0;
+        }
+        entry->current_iter = 0;
+    }
+
+    void snapshot(Snapshot &s)
+    {
+        s.raw(loop_table.array());
+        s.raw(use_loop);
+    }
+};
+
+// sums counters indexed by the PC and segments of the global history, together with the TAGE
+// prediction, and reverts TAGE when the sum confidently disagrees with it
+// the counters are summed and trained with the hashed perceptron kernels
+template <size_t TABLE_NUM,                          // number of counter tables, the first one is a bias table
+          size_t INDEX_WIDTH,                        // width of the index of every table
+          size_t CTR_WIDTH,                          // width of the counters
+          std::array<size_t, TABLE_NUM> SEGMENT_END, // history segments as in HashedPerceptron
+          size_t THRESHOLD_INIT = 6 * TABLE_NUM      // initial threshold of the sum
+          >
+    requires(CTR_WIDTH >= 2 && CTR_WIDTH <= 8)
+class StatisticalCorrector
+{
+  private:
+    static constexpr size_t SEGMENT_START(const size_t n)
+    {
+        return n ? SEGMENT_END[n - 1] : 0;
+    }
+
+    static constexpr size_t SEGMENT_LEN(const size_t n)
+    {
+        return SEGMENT_END[n] - SEGMENT_START(n);
+    }
+
+    static constexpr size_t MAX_HIST_LEN = SEGMENT_END[TABLE_NUM - 1];
+    static constexpr size_t TABLE_SIZE = exp2(INDEX_WIDTH);
+    static constexpr size_t ZERO_CTR = TABLE_SIZE * TABLE_NUM;
+    static constexpr size_t LANES = (TABLE_NUM + 7) / 8 * 8;
+    static constexpr int CTR_MIN = -int(exp2(CTR_WIDTH - 1));
+    static constexpr int CTR_MAX = int(exp2(CTR_WIDTH - 1)) - 1;
+    using Kernel = PerceptronKernel<LANES, TABLE_NUM, CTR_MIN, CTR_MAX>;
+
+    // weight of the TAGE prediction in the sum
+    static constexpr int32_t TAGE_WEIGHT = CTR_MAX * TABLE_NUM / 2;
+    static constexpr int32_t TAGE_WEIGHT_CONFIDENT = CTR_MAX * TABLE_NUM * 2;
+
+    ArenaArray<int8_t, ZERO_CTR + 1> ctrs; // the tables back to back, then the zero counter
+    History<std::max<size_t>(MAX_HIST_LEN, 1)> global_history;
+    int32_t threshold = THRESHOLD_INIT;
+    Counter<6> threshold_ctr = Counter<6>(exp2(size_t(5))); // up when reverting was wrong, down when it was right
+
+    // last lookup
+    uint32_t pos[LANES];
+    int32_t ctr[LANES];
+    int32_t sum;
+    bool tage_pred;
+
+    template <size_t... T>
+    void hashTables(uint64_t ip, std::index_sequence<T...>)
+    {
+        // the TAGE prediction takes the lowest index bit, so that both directions train apart
+        ((pos[T] = T * TABLE_SIZE
+                   + ((getXoredIndex<64, SEGMENT_LEN(T), INDEX_WIDTH - 1>(
+                           ip, global_history.segment(SEGMENT_START(T), SEGMENT_LEN(T)))
+                       << 1)
+                      | tage_pred)),
+         ...);
+    }
+
+  public:
+    StatisticalCorrector()
+    {
+        std::fill(std::begin(pos), std::end(pos), ZERO_CTR);
+    }
+
+    bool predict(uint64_t ip, bool tage_pred, bool confident)
+    {
+        this->tage_pred = tage_pred;
+        hashTables(ip, std::make_index_sequence<TABLE_NUM>());
+        // centered counters, 2c + 1
+        sum = 2 * Kernel::kernel.first(ctrs.data(), pos, ctr) + int32_t(TABLE_NUM);
+        sum += (tage_pred ? 1 : -1) * (confident ? TAGE_WEIGHT_CONFIDENT : TAGE_WEIGHT);
+        return (sum >= 0) != tage_pred && std::abs(sum) >= threshold ? !tage_pred : tage_pred;
+    }
+
+    void update(bool taken)
+    {
+        const bool sc_pred = sum >= 0;
+        if (sc_pred != tage_pred && std::abs(sum) >= threshold)
+        {
+            threshold_ctr.update(sc_pred != taken);
+            if (threshold_ctr.isStrong())
+            {
+                threshold = std::clamp<int32_t>(threshold + (threshold_ctr.get() ? 1 : -1), TABLE_NUM, 64 * TABLE_NUM);
+                threshold_ctr = Counter<6>(exp2(size_t(5)));
+            }
+        }
+        if (sc_pred != taken || std::abs(sum) < threshold)
+            Kernel::kernel.second(ctrs.data(), pos, ctr, taken);
+        global_history.push(taken);
+    }
+
+    // push the outcome without training, see IPredictor::skipBatch
+    void push(bool taken)
+    {
+        global_history.push(taken);
+    }
+
+    void snapshot(Snapshot &s)
+    {
+        s.raw(ctrs.array());
+        s.raw(global_history);
+        s.raw(threshold);
+        s.raw(threshold_ctr);
+    }
+};
+
+constexpr std::array<size_t, 6> default_sc_segment_end = {0, 4, 8, 13, 20, 32};
+using DefaultLoopPredictor = LoopPredictor<5, 10>;
+using DefaultStatisticalCorrector = StatisticalCorrector<6, 10, 6, default_sc_segment_end>;
+
+// a disabled stage takes no space and is never called
+struct DisabledStage
+{
+};
+
+// TAGE followed by an optional loop predictor, overriding TAGE on confident loops, and an optional
+// statistical corrector, which may revert the prediction so far
+template <typename TageT,                                    // any Tage<...>
+          bool WITH_LOOP,                                    // enable the loop predictor
+          bool WITH_SC,                                      // enable the statistical corrector
+          typename Loop = DefaultLoopPredictor,              // configuration of the loop predictor
+          typename Corrector = DefaultStatisticalCorrector, // configuration of the statistical corrector
+          size_t PC_SHIFT_AMT = 2                            // the shift amount of inst pc to discard lowest bits
+          >
+class TageScl : public IDirectionPredictor
+{
+  private:
+    TageT tage;
+    [[no_unique_address]] std::conditional_t<WITH_LOOP, Loop, DisabledStage> loop;
+    [[no_unique_address]] std::conditional_t<WITH_SC, Corrector, DisabledStage> sc;
+
+    // last prediction of each stage
+    bool tage_pred;
+    bool loop_pred;
+    bool prediction;
+
+    // how often a stage changed the prediction, and was right to
+    uint64_t loop_override = 0, loop_override_correct = 0;
+    uint64_t sc_revert = 0, sc_revert_correct = 0;
+
+  public:
+    explicit TageScl(uint64_t seed = 1) : tage(seed)
+    {
+    }
+
+    const std::string &getName() override
+    {
+        static const std::string name =
+            fmt::format("{}{}{}", tage.getName(), WITH_SC ? "-SC" : "", WITH_LOOP ? "-L" : "");
+        return name;
+    }
+
+    std::string report() override
+    {
+        auto report = IDirectionPredictor::report();
+        if constexpr (WITH_LOOP)
+            report += fmt::format("\t loop overrides = {} ({} correct)\n", loop_override, loop_override_correct);
+        if constexpr (WITH_SC)
+            report += fmt::format("\t sc reverts = {} ({} correct)\n", sc_revert, sc_revert_correct);
+        return report;
+    }
+
+    std::string probes() override
+    {
+        return tage.probes();
+    }
+
+    bool predict(uint64_t ip) override
+    {
+        prediction = loop_pred = tage_pred = tage.TageT::predict(ip);
+        ip >>= PC_SHIFT_AMT;
+        if constexpr (WITH_LOOP)
+        {
+            loop.lookup(ip);
+            if (loop.valid())
+                prediction = loop_pred = loop.prediction();
+        }
+        if constexpr (WITH_SC)
+            prediction = sc.predict(ip, loop_pred, loop_pred == tage_pred && tage.highConfidence());
+        return prediction;
+    }
+
+    void update(uint64_t ip, bool taken) override
+    {
+        if constexpr (WITH_LOOP)
+        {
+            loop_override += loop_pred != tage_pred;
+            loop_override_correct += loop_pred != tage_pred && loop_pred == taken;
+            loop.update(taken, tage_pred);
+        }
+        if constexpr (WITH_SC)
+        {
+            sc_revert += prediction != loop_pred;
+            sc_revert_correct += prediction != loop_pred && prediction == taken;
+            sc.update(taken);
+        }
+        tage.TageT::update(ip, taken);
+    }
+
+    void checkPredBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<TageScl>(records);
+    }
+
+    void warmBatch(std::span<const BranchRecord> records) override
+    {
+        checkPredBatchImpl<TageScl, false>(records);
+    }
+
+    // the loop predictor keeps its iteration counts, which catch up at the next exit of every loop
+    void skipBatch(std::span<const BranchRecord> records) override
+    {
+        tage.skipBatch(records);
+        if constexpr (WITH_SC)
+            for (const auto &record : records)
+                if (record.kind == BranchKind::CONDITIONAL)
+                    sc.push(record.taken);
+    }
+
+    void snapshot(Snapshot &s) override
+    {
+        tage.snapshot(s);
+        if constexpr (WITH_LOOP)
+            loop.snapshot(s);
+        if constexpr (WITH_SC)
+            sc.snapshot(s);
+    }
+};
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef __TRACE_HH__
+#define __TRACE_HH__
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/core.h>
+#include <istream>
+#include <span>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+
+#include "bp.hh"
+
+// binary branch trace: a header followed by BranchRecords laid out exactly as in memory,
+// so a mapped trace can be handed to checkPredBatch without decoding
+struct TraceHeader
+{
+    static constexpr char MAGIC[8] = "BPTRACE";
+    static constexpr uint32_t VERSION = 1;
+
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t record_num;
+    uint64_t reserved;
+};
+
+static_assert(sizeof(TraceHeader) % alignof(BranchRecord) == 0);
+static_assert(std::is_trivially_copyable_v<BranchRecord> && std::is_standard_layout_v<BranchRecord>);
+
+inline std::system_error traceError(const std::string &what, const std::string &path)
+{
+    return std::system_error(errno, std::generic_category(), fmt::format("{} {}", what, path));
+}
+
+class TraceWriter
+{
+  private:
+    std::string path;
+    FILE *file;
+    uint64_t record_num = 0;
+
+    void writeHeader()
+    {
+        TraceHeader header = {};
+        std::memcpy(header.magic, TraceHeader::MAGIC, sizeof(header.magic));
+        header.version = TraceHeader::VERSION;
+        header.record_size = sizeof(BranchRecord);
+        header.record_num = record_num;
+        if (std::fseek(file, 0, SEEK_SET) || std::fwrite(&header, sizeof(header), 1, file) != 1)
+            throw traceError("failed to write trace header of", path);
+    }
+
+  public:
+    explicit TraceWriter(const std::string &path) : path(path), file(std::fopen(path.c_str(), "wb"))
+    {
+        if (!file)
+            throw traceError("failed to create trace", path);
+        writeHeader(); // placeholder until the record number is known
+    }
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    ~TraceWriter()
+    {
+        if (!file)
+            return;
+        try
+        {
+            close();
+        }
+        catch (const std::system_error &)
+        {
+            // destructors must not throw, call close() to observe the error
+        }
+    }
+
+    void write(const BranchRecord &record)
+    {
+        // copy field by field so that padding bytes in the file are always zero
+        BranchRecord packed;
+        std::memset(&packed, 0, sizeof(packed));
+        packed.ip = record.ip;
+        packed.target = record.target;
+        packed.taken = record.taken;
+        packed.kind = record.kind;
+        packed.inst_size = record.inst_size;
+        if (std::fwrite(&packed, sizeof(packed), 1, file) != 1)
+            throw traceError("failed to write trace", path);
+        record_num++;
+    }
+
+    void close()
+    {
+        if (!file)
+            return; // already closed, or closing failed
+        try
+        {
+            writeHeader();
+        }
+        catch (const std::system_error &)
+        {
+            std::fclose(std::exchange(file, nullptr));
+            throw;
+        }
+        if (std::fclose(std::exchange(file, nullptr)))
+            throw traceError("failed to close trace", path);
+    }
+};
+
+// text traces hold one branch per line: <ip> <target> <taken> <kind> [inst_size]
+// ip and target are hex, taken is 0/1 and kind is one of cond, uncond, call, ret, ind
+inline BranchRecord parseTextRecord(const std::string &line)
+{
+    std::istringstream in(line);
+    BranchRecord record = {};
+    std::string kind;
+    unsigned taken, inst_size;
+    in >> std::hex >> record.ip >> record.target >> std::dec >> taken >> kind;
+    if (!in && !(in.eof() && !kind.empty()))
+        throw std::invalid_argument(fmt::format("malformed trace line: {}", line));
+    if (!(in >> inst_size))
+    {
+        if (!in.eof())
+            throw std::invalid_argument(fmt::format("malformed trace line: {}", line));
+        inst_size = 4;
+    }
+    if (inst_size > UINT8_MAX)
+        throw std::invalid_argument(fmt::format("instruction size out of range: {}", line));
+
+    if (kind == "cond")
+        record.kind = BranchKind::CONDITIONAL;
+    else if (kind == "uncond")
+        record.kind = BranchKind::UNCONDITIONAL;
+    else if (kind == "call")
+        record.kind = BranchKind::CALL;
+    else if (kind == "ret")
+        record.kind = BranchKind::RETURN;
+    else if (kind == "ind")
+        record.kind = BranchKind::INDIRECT;
+    else
+        throw std::invalid_argument(fmt::format("unknown branch kind: {}", kind));
+    record.taken = taken;
+    record.inst_size = inst_size;
+    return record;
+}
+
+inline uint64_t convertTextTrace(std::istream &text, const std::string &path)
+{
+    TraceWriter writer(path);
+    uint64_t record_num = 0;
+    for (std::string line; std::getline(text, line);)
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        writer.write(parseTextRecord(line));
+        record_num++;
+    }
+    writer.close();
+    return record_num;
+}
+
+// read-only mapping of a binary trace, records are served straight from the page cache
+class MappedTrace
+{
+  private:
+    void *mapping = MAP_FAILED;
+    size_t mapping_size = 0;
+    std::span<const BranchRecord> records;
+    size_t cursor = 0;
+
+  public:
+    explicit MappedTrace(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw traceError("failed to open trace", path);
+        struct stat st;
+        if (::fstat(fd, &st))
+        {
+            ::close(fd);
+            throw traceError("failed to stat trace", path);
+        }
+        mapping_size = st.st_size;
+        if (mapping_size < sizeof(TraceHeader))
+        {
+            ::close(fd);
+            throw std::runtime_error(fmt::format("truncated trace {}", path));
+        }
+        mapping = ::mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED)
+            throw traceError("failed to map trace", path);
+        ::madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+        const auto *header = static_cast<const TraceHeader *>(mapping);
+        if (std::memcmp(header->magic, TraceHeader::MAGIC, sizeof(header->magic))
+            || header->version != TraceHeader::VERSION || header->record_size != sizeof(BranchRecord)
+            || header->record_num > (mapping_size - sizeof(TraceHeader)) / sizeof(BranchRecord))
+        {
+            ::munmap(mapping, mapping_size);
+            throw std::runtime_error(fmt::format("invalid trace {}", path));
+        }
+        const auto *first = reinterpret_cast<const BranchRecord *>(header + 1);
+        records = std::span(first, header->record_num);
+    }
+
+    MappedTrace(const MappedTrace &) = delete;
+    MappedTrace &operator=(const MappedTrace &) = delete;
+
+    ~MappedTrace()
+    {
+        if (mapping != MAP_FAILED)
+            ::munmap(mapping, mapping_size);
+    }
+
+    size_t size() const
+    {
+        return records.size();
+    }
+
+    std::span<const BranchRecord> all() const
+    {
+        return records;
+    }
+
+    // the next batch of at most n records, empty at the end of the trace
+    std::span<const BranchRecord> next(size_t n)
+    {
+        auto batch = records.subspan(cursor, std::min(n, records.size() - cursor));
+        cursor += batch.size();
+        return batch;
+    }
+
+    void rewind()
+    {
+        cursor = 0;
+    }
+};
+
+#endif
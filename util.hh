@@ -4,6 +4,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <string_view>
+#include <type_traits>
 
 constexpr unsigned lg2(uint64_t n)
 {
@@ -21,11 +23,37 @@ constexpr uint64_t bitmask(std::size_t begin, std::size_t end = 0)
     return ((1ull << (begin - end)) - 1) << end;
 }
 
+// the smallest unsigned integral type holding at least BITS bits
+template <size_t BITS>
+    requires(BITS <= 64)
+using LeastUint = std::conditional_t<
+    BITS <= 8, uint8_t, std::conditional_t<BITS <= 16, uint16_t, std::conditional_t<BITS <= 32, uint32_t, uint64_t>>>;
+
 constexpr uint64_t spliceBits(uint64_t upper, uint64_t lower, std::size_t bits)
 {
     return (upper & ~bitmask(bits)) | (lower & bitmask(bits));
 }
 
+// xorshift64, cheap enough to give every predictor its own reproducible random stream
+class Xorshift
+{
+  private:
+    uint64_t state;
+
+  public:
+    explicit Xorshift(uint64_t seed) : state(seed ? seed : 0x9e3779b97f4a7c15ull) // the state must never be 0
+    {
+    }
+
+    uint64_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+};
+
 enum class IndexAlgo
 {
     CONCAT,
@@ -33,6 +61,20 @@ enum class IndexAlgo
     HASH
 };
 
+constexpr std::string_view indexAlgoName(IndexAlgo algo)
+{
+    switch (algo)
+    {
+    case IndexAlgo::CONCAT:
+        return "CONCAT";
+    case IndexAlgo::XOR:
+        return "XOR";
+    case IndexAlgo::HASH:
+        return "HASH";
+    }
+    return "";
+}
+
 template <size_t ORIGINAL_SIZE, size_t FOLDED_SIZE>
 uint64_t foldHistory(auto &history)
 {
@@ -50,6 +92,43 @@ uint64_t foldHistory(auto &history)
     return folded_hist;
 }
 
+// incrementally maintained equivalent of foldHistory(history) where history[0] is the newest bit
+// whole chunks form a circular shift register, the last partial chunk a plain shift register
+struct FoldedHistory
+{
+    size_t original_size = 0;
+    size_t folded_size = 0;
+    size_t chunked_size = 0; // bits covered by whole chunks
+    uint64_t chunked = 0;
+    uint64_t tail = 0;
+
+    FoldedHistory() = default;
+    FoldedHistory(size_t original_size, size_t folded_size)
+        : original_size(original_size), folded_size(folded_size),
+          chunked_size(original_size / folded_size * folded_size)
+    {
+    }
+
+    uint64_t get() const
+    {
+        return chunked ^ tail;
+    }
+
+    // must be called before the newest bit is pushed into history
+    void update(bool newest, const auto &history)
+    {
+        const auto tail_size = original_size - chunked_size;
+        const bool to_tail = chunked_size ? history[chunked_size - 1] : newest;
+        if (chunked_size)
+        {
+            chunked = (chunked >> 1) | ((chunked & 1) << (folded_size - 1));
+            chunked ^= uint64_t(newest ^ to_tail) << (folded_size - 1);
+        }
+        if (tail_size)
+            tail = (tail >> 1) | (uint64_t(to_tail) << (tail_size - 1));
+    }
+};
+
 template <size_t ORIGINAL_SIZE, size_t FOLDED_SIZE>
 uint64_t fold(uint64_t val)
 {